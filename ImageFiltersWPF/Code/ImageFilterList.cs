@@ -40,6 +40,7 @@ namespace ImageFiltersWPF.Code
             _filterList.Add( "Laplacian of Gaussian" );
             _filterList.Add( "Harris Corner Detector" );
             _filterList.Add( "Shi-Tomasi Corner Detector" );
+            _filterList.Add( "Canny Edge Detector" );
         }
     }
 }
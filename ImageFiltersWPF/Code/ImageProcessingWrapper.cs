@@ -54,6 +54,16 @@ namespace ImageFiltersWPF.Code
         [DllImport( "ImageProcessing.dll" )] private extern static int LaplacianOfGaussian( [In] byte[ ] inBGRA, [Out] byte[ ] outBGRA, [In] int stride, [In] int width, [In] int height, [In] KVP[ ] parameters, int nParameters );
         [DllImport( "ImageProcessing.dll" )] private extern static int HarrisCornerDetector( [In] byte[ ] inBGRA, [Out] byte[ ] outBGRA, [In] int stride, [In] int width, [In] int height, [In] KVP[ ] parameters, int nParameters );
         [DllImport( "ImageProcessing.dll" )] private extern static int ShiTomasiCornerDetector( [In] byte[ ] inBGRA, [Out] byte[ ] outBGRA, [In] int stride, [In] int width, [In] int height, [In] KVP[ ] parameters, int nParameters );
+        [DllImport( "ImageProcessing.dll" )] private extern static int CannyEdgeDetector( [In] byte[ ] inBGRA, [Out] byte[ ] outBGRA, [In] int stride, [In] int width, [In] int height, [In] KVP[ ] parameters, int nParameters );
+
+        /// <summary>
+        /// Reads back the values reported by the last filter (threshold, mean...). The value of each KVP
+        /// is replaced by the reported value of the same name.
+        /// </summary>
+        /// <param name="parameters">Arry of KVP, one for each value to read</param>
+        /// <param name="nParameters">Number of KVP structures in the KVP array</param>
+        /// <returns>The number of values found</returns>
+        [DllImport( "ImageProcessing.dll" )] private extern static int Statistics( [In, Out] KVP[ ] parameters, int nParameters );
 
         /// <summary>
         /// Constructor loads the DLL 
@@ -75,6 +85,19 @@ namespace ImageFiltersWPF.Code
         }
 
 
+        /// <summary>
+        /// Returns a value reported by the last filter that ran, such as the threshold it chose
+        /// </summary>
+        /// <param name="name">Name of the value</param>
+        /// <param name="defValue">Value returned if the last filter did not report it</param>
+        public double GetStatistic( string name, double defValue )
+        {
+            KVP[ ] values = new KVP[ ] { new KVP( name, defValue ) };
+            Statistics( values, values.Length );
+            return values[ 0 ].value;
+        }
+
+
         /// <summary>
         /// The main processing function. Once everything has been setup in the Client GUI and 
         /// this class has been initialized, this function gets called to process the image.
@@ -127,6 +150,10 @@ namespace ImageFiltersWPF.Code
                     parameters = new KVP[ ] { new KVP( "radius", 3.0 ), new KVP( "openMP", multiCoreFlag) };
                     runFilter = ShiTomasiCornerDetector;
                     break;
+                case "Canny Edge Detector" :
+                    parameters = new KVP[ ] { new KVP( "radius", 2.0 ), new KVP( "openMP", multiCoreFlag) };
+                    runFilter = CannyEdgeDetector;
+                    break;
                 default:
                     return;
             }
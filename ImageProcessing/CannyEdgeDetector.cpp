@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include <math.h>
+#include <vector>
+#include "omp.h"
+#include "Statistics.h"
+#include "Labeling.h"
+#include "Placement.h"
+
+using namespace std;
+
+extern "C" int __stdcall GaussianBlur(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr);
+
+extern "C" __declspec(dllexport) int __stdcall CannyEdgeDetector(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	// Pack the following structure on one-byte boundaries: smallest possible alignment
+	// This allows to use the minimal memory space for this type: exact fit - no padding
+#pragma pack(push, 1)
+	struct BGRA {
+		BYTE B, G, R, A;
+	};
+#pragma  pack(pop)		// Back to the default packing mode
+
+	// Reading the input parameters
+	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int mode = parameter("auto", 0, arr, nArr);						// 0: fixed thresholds, 1: Otsu, 2: percentile
+	double high = parameter("high", 0.20 * 255, arr, nArr);				// Magnitude above which a pixel is an edge
+	const double ratio = parameter("ratio", 0.5, arr, nArr);				// Low threshold, relative to the high one
+	ClearReport();
+
+	const int n = width * height;
+	int rc = -1;
+
+	// Creating a temporary memory to keep the blurred grayscale picture, and the planes of the intermediate results
+	BYTE* tmpBGR = new BYTE[stride*height];
+	float* magnitude = new float[n];
+	float* suppressed = new float[n];
+	BYTE* direction = new BYTE[n];
+	int* labels = new int[n];
+	BYTE* strong = new BYTE[n];
+	// With the placement, the threads are pinned and the planes are first touched by the threads
+	// which process their rows. The bands of the labeling are whole rows as well.
+	Placement* placement = BeginPlacement(arr, nArr, openMP);
+	FirstTouch(placement, tmpBGR, stride, height, openMP);
+	FirstTouch(placement, magnitude, width * sizeof(float), height, openMP);
+	FirstTouch(placement, suppressed, width * sizeof(float), height, openMP);
+	FirstTouch(placement, direction, width, height, openMP);
+	FirstTouch(placement, labels, width * sizeof(int), height, openMP);
+	FirstTouch(placement, strong, width, height, openMP);
+	if (tmpBGR && magnitude && suppressed && direction && labels && strong) {
+		// Apply the Gaussian Blur, then converting the picture into a grayscale picture
+		rc = GaussianBlur(inBGR, tmpBGR, stride, width, height, arr, nArr);
+		if (!rc) {
+			Grayscale(tmpBGR, tmpBGR, stride, width, height, openMP, placement);
+
+			// In automatic mode, the greatest magnitude of each thread is kept in the gradient loop: it gives the scale
+			// of the histogram, which is then filled in the suppression loop without another pass over the magnitudes
+			int max_threads = omp_get_max_threads();
+			vector<float> greatest(max_threads, 0);
+
+			// Applying the Sobel operators, keeping the magnitude of the gradient and its direction
+			// quantized on 4 values: 0 horizontal, 1 and 3 diagonals, 2 vertical.
+			// If the boolean openMP is true, this directive is interpreted so that the following for loop
+			// will be run on multiple cores.
+#pragma omp parallel for schedule(static) if(openMP)
+			for (int i = 0; i < height; ++i) {
+				BGRA* p = reinterpret_cast<BGRA*>(tmpBGR + i * stride);
+				float* m = magnitude + i * width;
+				BYTE* d = direction + i * width;
+				CountBytes(placement, width * (3 * sizeof(BGRA) + sizeof(float) + 1));	// 3 rows read, magnitude and direction written
+				float rowGreatest = 0;
+				for (int j = 0; j < width; ++j) {
+					if (i == 0 || j == 0 || i == height - 1 || j == width - 1) {
+						m[j] = 0;	// if convolution not possible (near the edges)
+						d[j] = 0;
+						continue;
+					}
+					BGRA* up = reinterpret_cast<BGRA*>(tmpBGR + (i - 1) * stride);
+					BGRA* down = reinterpret_cast<BGRA*>(tmpBGR + (i + 1) * stride);
+					float gx = (up[j + 1].G + 2 * p[j + 1].G + down[j + 1].G) - (up[j - 1].G + 2 * p[j - 1].G + down[j - 1].G);
+					float gy = (down[j - 1].G + 2 * down[j].G + down[j + 1].G) - (up[j - 1].G + 2 * up[j].G + up[j + 1].G);
+					m[j] = sqrt(gx * gx + gy * gy);
+					rowGreatest = max(rowGreatest, m[j]);
+					// tan(22.5) = 0.4142, tan(67.5) = 2.4142
+					float ax = fabs(gx), ay = fabs(gy);
+					if (ay <= 0.4142f * ax)
+						d[j] = 0;
+					else if (ay >= 2.4142f * ax)
+						d[j] = 2;
+					else
+						d[j] = gx * gy > 0 ? 1 : 3;
+				}
+				int id_thread = omp_get_thread_num();
+				greatest[id_thread] = max(greatest[id_thread], rowGreatest);
+			}
+			float scale = 0;
+			for (int t = 0; t < max_threads; t++)
+				scale = max(scale, greatest[t]);
+			const float k = scale > 0 ? 255 / scale : 0;
+			Histogram* partial = mode ? PartialHistograms() : NULL;
+
+			// Non-maximum suppression: only the pixels greater than their two neighbors
+			// along the direction of the gradient are kept, which makes the edges thin.
+			const int dx[4][2] = { { -1,1 },{ -1,1 },{ 0,0 },{ 1,-1 } };
+			const int dy[4][2] = { { 0,0 },{ -1,1 },{ -1,1 },{ -1,1 } };
+#pragma omp parallel for schedule(static) if(openMP)
+			for (int i = 0; i < height; ++i) {
+				CountBytes(placement, width * (4 * sizeof(float) + 1));	// 3 rows of magnitudes and a direction read, one written
+				unsigned __int64* bins = partial ? partial[omp_get_thread_num()].bins : NULL;
+				for (int j = 0; j < width; ++j) {
+					int index = i * width + j;
+					float m = magnitude[index];
+					if (i == 0 || j == 0 || i == height - 1 || j == width - 1 || m == 0) {
+						suppressed[index] = 0;
+						continue;
+					}
+					int d = direction[index];
+					float m1 = magnitude[(i + dy[d][0]) * width + j + dx[d][0]];
+					float m2 = magnitude[(i + dy[d][1]) * width + j + dx[d][1]];
+					float kept = (m >= m1 && m > m2) ? m : 0;
+					suppressed[index] = kept;
+					// Only the pixels left by the suppression are counted in the histogram
+					if (bins && kept > 0) {
+						float v = kept * k;
+						bins[v >= 255 ? 255 : (int)v]++;
+					}
+				}
+			}
+
+			// Choosing the high threshold from the histogram of the magnitudes of the pixels left by the suppression
+			if (mode) {
+				Histogram hist;
+				MergeHistograms(partial, &hist);
+				high = AutoThreshold(&hist, high, scale, arr, nArr, true);
+			}
+			const double low = high * ratio;
+
+			// Hysteresis. The pixels above the low threshold are grouped in connected sets,
+			// and a set is kept if at least one of its pixels is above the high threshold.
+			// The suppressed pixels are never part of a set, even if a threshold is 0.
+			LabelComponents([&](int i, int j) -> BYTE {
+				float m = suppressed[i * width + j];
+				return m <= 0 ? 0 : m >= high ? 2 : m >= low ? 1 : 0;
+			}, labels, strong, width, height, openMP);
+
+			// Writing the results to the output image
+#pragma omp parallel for schedule(static) if(openMP)
+			for (int i = 0; i < height; ++i) {
+				BGRA* q = reinterpret_cast<BGRA*>(outBGR + i * stride);
+				CountBytes(placement, width * (sizeof(int) + sizeof(BGRA)));	// labels read, output row written
+				for (int j = 0; j < width; ++j) {
+					int label = labels[i * width + j];
+					bool edge = label != -1 && strong[label];
+					q[j] = edge ? BGRA{ 255,255,255,255 } : BGRA{ 0,0,0,255 };
+				}
+			}
+		}
+	}
+
+	// Delete the allocated memory for the temporary images
+	delete[] tmpBGR;
+	delete[] magnitude;
+	delete[] suppressed;
+	delete[] direction;
+	delete[] labels;
+	delete[] strong;
+	EndPlacement(placement);
+	return rc;
+}
@@ -0,0 +1,170 @@
+#include "stdafx.h"
+#include <vector>
+#include <unordered_map>
+#include "omp.h"
+#include "Statistics.h"
+#include "Labeling.h"
+
+using namespace std;
+
+// Table of the sets found by the last call to ConnectedComponents. Each client thread has its own table,
+// as it has its own reported values: the threads of the team use the table of the calling thread through a reference.
+static thread_local vector<Component> components;
+
+void ClearComponents()
+{
+	components.clear();
+}
+
+extern "C" __declspec(dllexport) int __stdcall ConnectedComponents(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	// Pack the following structure on one-byte boundaries: smallest possible alignment
+	// This allows to use the minimal memory space for this type: exact fit - no padding
+#pragma pack(push, 1)
+	struct BGRA {
+		BYTE B, G, R, A;
+	};
+#pragma  pack(pop)		// Back to the default packing mode
+
+	// Reading the input parameters
+	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const double threshold = parameter("threshold", -1, arr, nArr);		// Value for thresholding (%), -1 to label every non black pixel
+	const int mode = parameter("auto", 0, arr, nArr);						// 0: fixed threshold, 1: Otsu, 2: percentile
+	ClearReport();
+
+	// Choosing the luminance threshold, as Threshold does
+	double level = threshold * 255;
+	if (threshold >= 0 && mode) {
+		Histogram hist;
+		LuminanceHistogram(inBGR, stride, width, height, openMP, &hist);
+		level = AutoThreshold(&hist, level, 255, arr, nArr);
+	}
+
+	const int n = width * height;
+	int* labels = new int[n];
+	BYTE* marked = new BYTE[n];
+	if (!labels || !marked) {
+		delete[] labels;
+		delete[] marked;
+		return -1;
+	}
+
+	// Labeling the picture. The mask is either the luminance test of Threshold,
+	// or every pixel which is not black (the output of Threshold or of a detector).
+	int count;
+	if (threshold >= 0)
+		count = LabelComponents([&](int i, int j) -> BYTE {
+			BGRA* p = reinterpret_cast<BGRA*>(inBGR + i * stride);
+			return Luminance(p[j]) > level ? 1 : 0;
+		}, labels, marked, width, height, openMP);
+	else
+		count = LabelComponents([&](int i, int j) -> BYTE {
+			BGRA* p = reinterpret_cast<BGRA*>(inBGR + i * stride);
+			return (p[j].B | p[j].G | p[j].R) ? 1 : 0;
+		}, labels, marked, width, height, openMP);
+
+	// Numbering the sets from 1 in the order of their first pixel.
+	// The roots of each band are counted in parallel, then each band numbers its own roots.
+	// The output picture receives one 32 bits label per pixel.
+	const int bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	int* firstLabel = new int[bands + 1];
+#pragma omp parallel for if(openMP)
+	for (int b = 0; b < bands; ++b) {
+		int roots = 0;
+		for (int index = b * BAND_HEIGHT * width; index < min(height, (b + 1) * BAND_HEIGHT) * width; index++)
+			roots += labels[index] == index;
+		firstLabel[b + 1] = roots;
+	}
+	firstLabel[0] = 1;
+	for (int b = 0; b < bands; ++b)
+		firstLabel[b + 1] += firstLabel[b];
+#pragma omp parallel for if(openMP)
+	for (int b = 0; b < bands; ++b) {
+		int label = firstLabel[b];
+		for (int i = b * BAND_HEIGHT; i < min(height, (b + 1) * BAND_HEIGHT); ++i) {
+			int* q = reinterpret_cast<int*>(outBGR + i * stride);
+			for (int j = 0; j < width; ++j) {
+				if (labels[i * width + j] == i * width + j)
+					q[j] = label++;
+			}
+		}
+	}
+
+	// Every other pixel takes the number of its root, which is not written anymore
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		int* q = reinterpret_cast<int*>(outBGR + i * stride);
+		for (int j = 0; j < width; ++j) {
+			int root = labels[i * width + j];
+			if (root == -1)
+				q[j] = 0;
+			else if (root != i * width + j)
+				q[j] = reinterpret_cast<int*>(outBGR + (root / width) * stride)[root % width];
+		}
+	}
+
+	// Computing the area and the bounding box of every set, band by band.
+	// The root of a set is its first pixel, so the pixels of a band belong either to the sets numbered by the band,
+	// which only this band updates in the table, or to sets of the previous bands, kept in a small table of the band
+	// and merged at the end. The memory needed grows with the number of sets, not with the number of threads.
+	vector<vector<Component>> previous(bands);
+	vector<Component>& table = components;
+	table.resize(count);
+	for (int c = 0; c < count; c++)
+		table[c] = Component{ c + 1, 0, width, height, -1, -1 };
+#pragma omp parallel for if(openMP)
+	for (int b = 0; b < bands; ++b) {
+		unordered_map<int, int> slots;	// index in previous[b] of the sets of the previous bands
+		for (int i = b * BAND_HEIGHT; i < min(height, (b + 1) * BAND_HEIGHT); ++i) {
+			int* q = reinterpret_cast<int*>(outBGR + i * stride);
+			for (int j = 0; j < width; ++j) {
+				const int label = q[j];
+				if (label == 0)
+					continue;
+				Component* c;
+				if (label >= firstLabel[b])
+					c = &table[label - 1];
+				else {
+					auto slot = slots.find(label);
+					if (slot == slots.end()) {
+						slot = slots.insert(make_pair(label, (int)previous[b].size())).first;
+						previous[b].push_back(Component{ label, 0, width, height, -1, -1 });
+					}
+					c = &previous[b][slot->second];
+				}
+				c->area++;
+				c->left = min(c->left, j);
+				c->right = max(c->right, j);
+				c->top = min(c->top, i);
+				c->bottom = max(c->bottom, i);
+			}
+		}
+	}
+	for (int b = 0; b < bands; ++b) {
+		for (const Component& p : previous[b]) {
+			Component& merged = table[p.label - 1];
+			merged.area += p.area;
+			merged.left = min(merged.left, p.left);
+			merged.right = max(merged.right, p.right);
+			merged.top = min(merged.top, p.top);
+			merged.bottom = max(merged.bottom, p.bottom);
+		}
+	}
+	Report("components", count);
+
+	// Delete the allocated memory
+	delete[] firstLabel;
+	delete[] labels;
+	delete[] marked;
+	return 0;
+}
+
+// Gives back to the client the table of the sets found by the last call to ConnectedComponents on the calling thread,
+// empty if another filter ran since. At most nTable sets are copied. Returns the number of sets found.
+extern "C" __declspec(dllexport) int __stdcall ComponentTable(Component* table, int nTable)
+{
+	int count = components.size();
+	for (int c = 0; c < count && c < nTable; c++)
+		table[c] = components[c];
+	return count;
+}
@@ -0,0 +1,283 @@
+#include "stdafx.h"
+#include <math.h>
+#include <vector>
+#include "Statistics.h"
+#include "FFT.h"
+
+using namespace std;
+
+// Strategies Convolve can choose, reported as "strategy"
+enum Strategy { DIRECT = 0, SEPARABLE = 1, SPARSE = 2, FOURIER = 3 };
+
+// One coefficient of a kernel, with its position relative to the center pixel
+struct Tap {
+	int dx, dy;
+	float w;
+};
+
+// One separable term of a kernel: the column vector u (height) times the row vector v (width)
+struct Term {
+	vector<float> u, v;
+};
+
+// Decomposes the kernel as a sum of separable terms (singular value decomposition), the largest term first.
+// Each term is found by power iteration and removed from the kernel, until what remains is negligible.
+// Returns false if more than maxTerms terms would be needed.
+static bool Decompose(const Kernel* kernel, int maxTerms, vector<Term>& terms)
+{
+	const int w = kernel->width, h = kernel->height;
+	vector<double> A(kernel->values, kernel->values + w * h);
+	double norm = 0;
+	for (int k = 0; k < w * h; k++)
+		norm += A[k] * A[k];
+
+	for (int t = 0; t < maxTerms; t++) {
+		double remaining = 0;
+		for (int k = 0; k < w * h; k++)
+			remaining += A[k] * A[k];
+		if (remaining <= 1e-10 * norm)
+			return true;
+
+		// Starting from the row with the largest norm, so that the start is never orthogonal to the solution
+		vector<double> u(h), v(w);
+		int best = 0;
+		double bestNorm = -1;
+		for (int i = 0; i < h; i++) {
+			double n = 0;
+			for (int j = 0; j < w; j++)
+				n += A[i * w + j] * A[i * w + j];
+			if (n > bestNorm) {
+				bestNorm = n;
+				best = i;
+			}
+		}
+		for (int j = 0; j < w; j++)
+			v[j] = A[best * w + j];
+
+		// Power iteration: v <- At.A.v, normalized
+		double s = 0;
+		for (int it = 0; it < 100; it++) {
+			for (int i = 0; i < h; i++) {
+				u[i] = 0;
+				for (int j = 0; j < w; j++)
+					u[i] += A[i * w + j] * v[j];
+			}
+			for (int j = 0; j < w; j++) {
+				v[j] = 0;
+				for (int i = 0; i < h; i++)
+					v[j] += A[i * w + j] * u[i];
+			}
+			double n = 0;
+			for (int j = 0; j < w; j++)
+				n += v[j] * v[j];
+			n = sqrt(n);
+			for (int j = 0; j < w; j++)
+				v[j] /= n;
+			if (fabs(n - s) <= 1e-12 * n)
+				break;
+			s = n;
+		}
+		// u = A.v carries the singular value
+		for (int i = 0; i < h; i++) {
+			u[i] = 0;
+			for (int j = 0; j < w; j++)
+				u[i] += A[i * w + j] * v[j];
+		}
+
+		// Removing the term from the kernel
+		Term term;
+		for (int i = 0; i < h; i++) {
+			term.u.push_back(u[i]);
+			for (int j = 0; j < w; j++)
+				A[i * w + j] -= u[i] * v[j];
+		}
+		for (int j = 0; j < w; j++)
+			term.v.push_back(v[j]);
+		terms.push_back(term);
+	}
+
+	double remaining = 0;
+	for (int k = 0; k < w * h; k++)
+		remaining += A[k] * A[k];
+	return remaining <= 1e-10 * norm;
+}
+
+// Converts the picture into floats, 4 per pixel, replicating rx columns and ry rows around it
+static float* Pad(BYTE* inBGR, int stride, int width, int height, int rx, int ry, bool openMP)
+{
+	const int pw = width + 2 * rx, ph = height + 2 * ry;
+	float* padded = new float[pw * ph * 4];
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < ph; ++i) {
+		BYTE* p = inBGR + min(max(i - ry, 0), height - 1) * stride;
+		float* t = padded + i * pw * 4;
+		for (int j = 0; j < pw; ++j) {
+			BYTE* s = p + min(max(j - rx, 0), width - 1) * 4;
+			for (int c = 0; c < 4; c++)
+				t[j * 4 + c] = s[c];
+		}
+	}
+	return padded;
+}
+
+// Adds w times the source row to the destination row, n floats.
+// The loop is simple enough to be vectorized by the compiler.
+static inline void AddRow(float* dst, const float* src, float w, int n)
+{
+	for (int k = 0; k < n; k++)
+		dst[k] += w * src[k];
+}
+
+// Applies a list of taps. Each tap adds a shifted row of the padded picture to the output row,
+// so every tap is a contiguous loop over the row, whatever the size of the kernel.
+static void ApplyTaps(const float* padded, float* result, int width, int height, int rx, int ry, const vector<Tap>& taps, bool openMP)
+{
+	const int pw = width + 2 * rx;
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		float* acc = result + i * width * 4;
+		for (int k = 0; k < width * 4; k++)
+			acc[k] = 0;
+		for (size_t t = 0; t < taps.size(); t++) {
+			const float* src = padded + ((i + ry + taps[t].dy) * pw + rx + taps[t].dx) * 4;
+			AddRow(acc, src, taps[t].w, width * 4);
+		}
+	}
+}
+
+// Applies a dense kernel, every coefficient including the zeros. Each output pixel is accumulated
+// in registers over the rows of the kernel, instead of reading and writing the output row once per tap:
+// for small dense kernels the output never leaves the registers and the kernel rows are read contiguously.
+static void ApplyDense(const float* padded, float* result, int width, int height, const Kernel* kernel, bool openMP)
+{
+	const int kw = kernel->width, kh = kernel->height;
+	const int pw = width + kw - 1;
+	vector<float> k(kernel->values, kernel->values + kw * kh);
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		float* r = result + i * width * 4;
+		for (int j = 0; j < width; ++j) {
+			float acc[4] = { 0, 0, 0, 0 };
+			for (int y = 0; y < kh; y++) {
+				const float* src = padded + ((i + y) * pw + j) * 4;
+				const float* w = &k[y * kw];
+				for (int x = 0; x < kw; x++)
+					for (int c = 0; c < 4; c++)
+						acc[c] += w[x] * src[x * 4 + c];
+			}
+			for (int c = 0; c < 4; c++)
+				r[j * 4 + c] = acc[c];
+		}
+	}
+}
+
+// Applies the separable terms: for each term a horizontal pass on every padded row,
+// then a vertical pass adding the rows of the horizontal results to the output row.
+static void ApplyTerms(const float* padded, float* result, int width, int height, int rx, int ry, const vector<Term>& terms, bool openMP)
+{
+	const int pw = width + 2 * rx, ph = height + 2 * ry;
+	float* tmp = new float[width * ph * 4];
+	for (int k = 0; k < width * height * 4; k++)
+		result[k] = 0;
+
+	for (size_t t = 0; t < terms.size(); t++) {
+		const Term& term = terms[t];
+#pragma omp parallel for if(openMP)
+		for (int i = 0; i < ph; ++i) {
+			float* acc = tmp + i * width * 4;
+			for (int k = 0; k < width * 4; k++)
+				acc[k] = 0;
+			for (int x = 0; x < (int)term.v.size(); x++)
+				AddRow(acc, padded + (i * pw + x) * 4, term.v[x], width * 4);
+		}
+#pragma omp parallel for if(openMP)
+		for (int i = 0; i < height; ++i) {
+			float* acc = result + i * width * 4;
+			for (int y = 0; y < (int)term.u.size(); y++)
+				AddRow(acc, tmp + (i + y) * width * 4, term.u[y], width * 4);
+		}
+	}
+	delete[] tmp;
+}
+
+// Writes the results to the output image, rounding and clamping every channel
+static void Store(const float* result, BYTE* outBGR, int stride, int width, int height, bool openMP)
+{
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		const float* r = result + i * width * 4;
+		BYTE* q = outBGR + i * stride;
+		for (int j = 0; j < width; ++j) {
+			for (int c = 0; c < 3; c++) {
+				float v = r[j * 4 + c];
+				q[j * 4 + c] = v < 0 ? 0 : v > 255 ? 255 : (BYTE)(v + 0.5f);
+			}
+			q[j * 4 + 3] = 255;
+		}
+	}
+}
+
+extern "C" __declspec(dllexport) int __stdcall Convolve(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, Kernel* kernel, KVP* arr, int nArr)
+{
+	// Reading the input parameters
+	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	int strategy = parameter("strategy", -1, arr, nArr);					// -1: automatic, or the strategy to use
+	ClearReport();
+
+	if (!kernel || !kernel->values || kernel->width <= 0 || kernel->height <= 0 || kernel->width % 2 == 0 || kernel->height % 2 == 0)
+		return -1;
+	const int kw = kernel->width, kh = kernel->height;
+	const int rx = kw / 2, ry = kh / 2;
+
+	// Listing the non zero coefficients
+	vector<Tap> taps;
+	for (int i = 0; i < kh; i++)
+		for (int j = 0; j < kw; j++)
+			if (kernel->values[i * kw + j] != 0)
+				taps.push_back(Tap{ j - rx, i - ry, (float)kernel->values[i * kw + j] });
+
+	// Choosing the cheapest strategy, counting the operations per pixel:
+	//	- separable: each term costs kw + kh
+	//	- sparse: only the non zero coefficients, one pass over the output row per tap,
+	//	  when they are less than half of the kernel
+	//	- direct: every coefficient, accumulated in registers for each output pixel
+	//	- Fourier: the measured cost of the FFT path, used above the crossover
+	vector<Term> terms;
+	int nTaps = taps.size();
+	bool separable = Decompose(kernel, (nTaps - 1) / (kw + kh), terms);
+	if (strategy == SEPARABLE && !separable) {
+		terms.clear();
+		Decompose(kernel, min(kw, kh), terms);
+	}
+	double fftCost = FFTCost(kernel);
+	if (strategy < 0) {
+		strategy = separable && !terms.empty() ? SEPARABLE : 2 * nTaps < kw * kh ? SPARSE : DIRECT;
+		double cost = strategy == SEPARABLE ? terms.size() * (kw + kh) : strategy == SPARSE ? nTaps : kw * kh;
+		if (cost > fftCost)
+			strategy = FOURIER;
+	}
+
+	float* padded = Pad(inBGR, stride, width, height, rx, ry, openMP);
+	float* result = new float[width * height * 4];
+	if (strategy == SEPARABLE)
+		ApplyTerms(padded, result, width, height, rx, ry, terms, openMP);
+	else if (strategy == FOURIER)
+		FFTConvolve(padded, result, width, height, kernel, openMP);
+	else if (strategy == DIRECT)
+		ApplyDense(padded, result, width, height, kernel, openMP);
+	else
+		ApplyTaps(padded, result, width, height, rx, ry, taps, openMP);
+	Store(result, outBGR, stride, width, height, openMP);
+
+	// Reporting the choice
+	Report("strategy", strategy);
+	Report("terms", strategy == SEPARABLE ? terms.size() : 0);
+	Report("taps", nTaps);
+	// Radius from which a dense square kernel is faster with the FFT
+	Report("crossover", ceil((sqrt(fftCost) - 1) / 2));
+
+	// Delete the allocated memory
+	delete[] padded;
+	delete[] result;
+	return 0;
+}
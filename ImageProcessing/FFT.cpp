@@ -0,0 +1,257 @@
+#include "stdafx.h"
+#include <math.h>
+#include <complex>
+#include <vector>
+#include <map>
+#include <mutex>
+#include "omp.h"
+#include "Timer.h"
+#include "FFT.h"
+
+using namespace std;
+
+typedef complex<float> cfloat;
+
+// Smallest size of tile. 128 x 128 complex floats take 128 KB, which stays in the L2 cache.
+#define MIN_TILE 128
+
+// Tables needed by the transforms of size n
+struct Plan {
+	int n;
+	vector<int> reversed;		// bit reversed index of every element
+	vector<cfloat> twiddles;	// exp(-2.i.pi.k / n) for k < n / 2
+};
+
+// Plans, transformed kernels and measured costs, kept between calls until the DLL is unloaded
+static map<int, Plan*> plans;
+static map<vector<double>, vector<cfloat>> spectra;
+static map<int, double> tileCosts;
+static double tapCost = 0;
+static volatile float sink;
+static mutex cacheLock;
+
+// Returns the plan of size n, creating it the first time
+static const Plan* GetPlan(int n)
+{
+	lock_guard<mutex> lock(cacheLock);
+	Plan*& plan = plans[n];
+	if (!plan) {
+		plan = new Plan;
+		plan->n = n;
+		int bits = 0;
+		while ((1 << bits) < n)
+			bits++;
+		plan->reversed.resize(n);
+		for (int i = 0; i < n; i++) {
+			int r = 0;
+			for (int b = 0; b < bits; b++)
+				if (i & (1 << b))
+					r |= 1 << (bits - 1 - b);
+			plan->reversed[i] = r;
+		}
+		double pi = acos(-1.0);
+		for (int k = 0; k < n / 2; k++)
+			plan->twiddles.push_back(cfloat(cos(2 * pi * k / n), -sin(2 * pi * k / n)));
+	}
+	return plan;
+}
+
+// In place radix-2 transform of n values. The inverse transform is not divided by n.
+static void Transform(const Plan* plan, cfloat* data, bool inverse)
+{
+	const int n = plan->n;
+	for (int i = 0; i < n; i++) {
+		int r = plan->reversed[i];
+		if (r > i)
+			swap(data[i], data[r]);
+	}
+	for (int size = 2; size <= n; size *= 2) {
+		const int half = size / 2, step = n / size;
+		for (int start = 0; start < n; start += size) {
+			for (int k = 0; k < half; k++) {
+				cfloat w = plan->twiddles[k * step];
+				if (inverse)
+					w = conj(w);
+				cfloat t = w * data[start + k + half];
+				data[start + k + half] = data[start + k] - t;
+				data[start + k] += t;
+			}
+		}
+	}
+}
+
+// Two dimensional transform of n x n values: the rows of src are transformed,
+// src is transposed into dst, and the rows of dst are transformed.
+// The result in dst is transposed, which is undone by the next call.
+static void Transform2D(const Plan* plan, cfloat* src, cfloat* dst, bool inverse)
+{
+	const int n = plan->n;
+	for (int i = 0; i < n; i++)
+		Transform(plan, src + i * n, inverse);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			dst[j * n + i] = src[i * n + j];
+	for (int i = 0; i < n; i++)
+		Transform(plan, dst + i * n, inverse);
+}
+
+// Size of the tiles used for a kernel: the results of a tile must not reach further than the next tile
+static int TileSize(const Kernel* kernel)
+{
+	int needed = 2 * (max(kernel->width, kernel->height) - 1);
+	int n = MIN_TILE;
+	while (n < needed)
+		n *= 2;
+	return n;
+}
+
+// Returns the transform of the kernel for tiles of size n, divided by n * n so that the
+// inverse transform needs no scaling. The kernel is flipped, to compute a correlation as Convolve does.
+static vector<cfloat> GetSpectrum(const Plan* plan, const Kernel* kernel)
+{
+	const int n = plan->n, kw = kernel->width, kh = kernel->height;
+	vector<double> key;
+	key.push_back(n);
+	key.push_back(kw);
+	key.push_back(kh);
+	key.insert(key.end(), kernel->values, kernel->values + kw * kh);
+
+	lock_guard<mutex> lock(cacheLock);
+	auto found = spectra.find(key);
+	if (found != spectra.end())
+		return found->second;
+
+	// Only the last kernels are kept
+	if (spectra.size() >= 8)
+		spectra.clear();
+	vector<cfloat> a(n * n), spectrum(n * n);
+	for (int i = 0; i < kh; i++)
+		for (int j = 0; j < kw; j++)
+			a[i * n + j] = cfloat(kernel->values[(kh - 1 - i) * kw + (kw - 1 - j)] / ((double)n * n), 0);
+	Transform2D(plan, a.data(), spectrum.data(), false);
+	return spectra[key] = spectrum;
+}
+
+// Convolves one tile: the tile of the padded picture starting at (top, left) is transformed,
+// multiplied by the spectrum of the kernel and transformed back.
+// B and G are transformed together, as the real and imaginary parts of the same values; R alone.
+// The results are added to the output pixels they reach.
+static void ConvolveTile(const Plan* plan, const cfloat* spectrum, cfloat* work, const float* padded, int pw, int ph,
+	float* result, int width, int height, int kw, int kh, int top, int left, int tile_x, int tile_y)
+{
+	const int n = plan->n;
+	cfloat* bg = work;
+	cfloat* r = work + n * n;
+	cfloat* tmp = work + 2 * n * n;
+
+	for (int k = 0; k < n * n; k++)
+		bg[k] = r[k] = 0;
+	for (int u = 0; u < tile_y && top + u < ph; u++) {
+		const float* p = padded + ((top + u) * pw + left) * 4;
+		for (int v = 0; v < tile_x && left + v < pw; v++) {
+			bg[u * n + v] = cfloat(p[v * 4], p[v * 4 + 1]);
+			r[u * n + v] = cfloat(p[v * 4 + 2], 0);
+		}
+	}
+
+	Transform2D(plan, bg, tmp, false);
+	for (int k = 0; k < n * n; k++)
+		tmp[k] *= spectrum[k];
+	Transform2D(plan, tmp, bg, true);
+
+	Transform2D(plan, r, tmp, false);
+	for (int k = 0; k < n * n; k++)
+		tmp[k] *= spectrum[k];
+	Transform2D(plan, tmp, r, true);
+
+	// Element (u, v) of the tile is element (top + u, left + v) of the full convolution,
+	// whose valid part starts at (kh - 1, kw - 1)
+	for (int u = 0; u < tile_y + kh - 1; u++) {
+		int i = top + u - (kh - 1);
+		if (i < 0 || i >= height)
+			continue;
+		float* q = result + i * width * 4;
+		for (int v = 0; v < tile_x + kw - 1; v++) {
+			int j = left + v - (kw - 1);
+			if (j < 0 || j >= width)
+				continue;
+			q[j * 4] += bg[u * n + v].real();
+			q[j * 4 + 1] += bg[u * n + v].imag();
+			q[j * 4 + 2] += r[u * n + v].real();
+		}
+	}
+}
+
+void FFTConvolve(const float* padded, float* result, int width, int height, const Kernel* kernel, bool omp)
+{
+	const int kw = kernel->width, kh = kernel->height;
+	const int pw = width + kw - 1, ph = height + kh - 1;
+	const Plan* plan = GetPlan(TileSize(kernel));
+	const vector<cfloat> spectrum = GetSpectrum(plan, kernel);
+	const int n = plan->n;
+
+	// Each tile of the picture gives a tile of n x n results
+	const int tile_x = n - kw + 1, tile_y = n - kh + 1;
+	const int tiles_x = (pw + tile_x - 1) / tile_x, tiles_y = (ph + tile_y - 1) / tile_y;
+
+	for (int k = 0; k < width * height * 4; k++)
+		result[k] = 0;
+
+	// Working memory for each thread
+	int max_threads = omp_get_max_threads();
+	cfloat* work = new cfloat[max_threads * 3 * n * n];
+
+	// The results of a tile overlap its right and bottom neighbors only,
+	// so the tiles are processed in four phases, the tiles of a phase never overlapping each other.
+	for (int phase = 0; phase < 4; phase++) {
+		const int py = phase / 2, px = phase % 2;
+		const int count_x = (tiles_x - px + 1) / 2, count_y = (tiles_y - py + 1) / 2;
+#pragma omp parallel for if(omp)
+		for (int t = 0; t < count_x * count_y; t++) {
+			int ty = py + 2 * (t / count_x), tx = px + 2 * (t % count_x);
+			ConvolveTile(plan, spectrum.data(), work + omp_get_thread_num() * 3 * n * n, padded, pw, ph,
+				result, width, height, kw, kh, ty * tile_y, tx * tile_x, tile_x, tile_y);
+		}
+	}
+
+	delete[] work;
+}
+
+double FFTCost(const Kernel* kernel)
+{
+	const int n = TileSize(kernel);
+	const Plan* plan = GetPlan(n);
+	lock_guard<mutex> lock(cacheLock);
+
+	// Cost of a direct tap: adding a shifted row of 4 floats per pixel, per pixel
+	if (tapCost == 0) {
+		const int len = 4096, repeat = 2000;
+		vector<float> dst(len, 0), src(len, 1);
+		Timer timer(Timer::NS);
+		for (int r = 0; r < repeat; r++) {
+			float w = 1.0f / (r + 1);
+			for (int k = 0; k < len; k++)
+				dst[k] += w * src[k];
+		}
+		tapCost = max(1.0, (double)timer.elapsed64()) / (repeat * len / 4.0);
+		sink = dst[len / 2];	// Prevents the loop from being optimized away
+	}
+
+	// Cost of a tile: four transforms and two products
+	double& tileCost = tileCosts[n];
+	if (tileCost == 0) {
+		vector<cfloat> a(n * n, cfloat(1, 0)), b(n * n);
+		Timer timer(Timer::NS);
+		for (int t = 0; t < 4; t++) {
+			Transform2D(plan, a.data(), b.data(), false);
+			for (int k = 0; k < n * n; k++)
+				b[k] *= a[k];
+		}
+		sink = b[0].real();
+		tileCost = max(1.0, (double)timer.elapsed64());
+	}
+
+	// Each tile gives (n - kw + 1) x (n - kh + 1) output pixels
+	double pixels = (double)(n - kernel->width + 1) * (n - kernel->height + 1);
+	return tileCost / pixels / tapCost;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Convolution by Fast Fourier Transforms, for the kernels too large to be applied directly.
+// The picture is cut into tiles sized to stay in cache. Each tile is transformed, multiplied by the
+// transform of the kernel, and transformed back; the results of the tiles overlap and are added (overlap-add).
+// The transforms are radix-2 and written in plain C++. The tables of the transforms and the transforms of the
+// kernels are kept between calls, so that processing frames of the same size with the same kernel reuses them.
+
+// Convolves a picture of floats (4 per pixel: B, G, R, A), padded by kernel->width / 2 columns and
+// kernel->height / 2 rows on each side, with the kernel. Same convention as the direct strategies of Convolve:
+// result[i][j] = sum of kernel[y][x] * padded[i + y][j + x], for the B, G and R channels.
+// The tiles of each of the four phases of the overlap-add are processed in parallel.
+void FFTConvolve(const float* padded, float* result, int width, int height, const Kernel* kernel, bool omp);
+
+// Cost of FFTConvolve per output pixel, as a number of taps of a direct convolution.
+// The cost of a tap and of a tile are measured the first time a size of tile is used.
+double FFTCost(const Kernel* kernel);
@@ -4,9 +4,138 @@
 #include <omp.h>
 #include <fstream>
 #include "Routine.h"
+#include "Statistics.h"
+#include "Placement.h"
 
 using namespace std;
 
+// Number of columns processed together by the vertical pass of the recursive filter.
+// Each row of a block is contiguous in memory, so the block stays in cache while walking down the columns.
+#define COLUMN_BLOCK 16
+
+// Triggs - Widom boundary conditions for the backward pass.
+// From the last three values of the forward pass (w1, w2, w3) and the last input value x,
+// computes the three first states of the backward pass as if the border was replicated to infinity.
+static inline void BackwardInit(const float M[9], float B, float x, float w1, float w2, float w3, float& y1, float& y2, float& y3)
+{
+	float d1 = w1 - x, d2 = w2 - x, d3 = w3 - x;
+	y1 = x + B * (M[0] * d1 + M[1] * d2 + M[2] * d3);
+	y2 = x + B * (M[3] * d1 + M[4] * d2 + M[5] * d3);
+	y3 = x + B * (M[6] * d1 + M[7] * d2 + M[8] * d3);
+}
+
+// Recursive (IIR) Gaussian filter, Young - van Vliet formulation.
+// Each line is filtered forward then backward with a third order recursion.
+// The cost per pixel does not depend on sigma, which makes it suited to very large blurs.
+static int RecursiveGaussianBlur(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, double sigma, bool openMP)
+{
+	// The approximation does not hold below 0.5
+	if (sigma < 0.5)
+		sigma = 0.5;
+
+	// Computing the coefficients of the recursion
+	double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+	double b0 = 1.57825 + 2.44413 * q + 1.4281 * q*q + 0.422205 * q*q*q;
+	float b1 = (2.44413 * q + 2.85619 * q*q + 1.26661 * q*q*q) / b0;
+	float b2 = -(1.4281 * q*q + 1.26661 * q*q*q) / b0;
+	float b3 = (0.422205 * q*q*q) / b0;
+	float B = 1 - (b1 + b2 + b3);
+
+	// Triggs matrix, used to start the backward pass
+	double a1(b1), a2(b2), a3(b3);
+	double scale = 1.0 / ((1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3));
+	float M[9];
+	M[0] = scale * (-a3 * a1 + 1.0 - a3 * a3 - a2);
+	M[1] = scale * (a3 + a1) * (a2 + a3 * a1);
+	M[2] = scale * a3 * (a1 + a3 * a2);
+	M[3] = scale * (a1 + a3 * a2);
+	M[4] = -scale * (a2 - 1.0) * (a2 + a3 * a1);
+	M[5] = -scale * a3 * (a3 * a1 + a3 * a3 + a2 - 1.0);
+	M[6] = scale * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+	M[7] = scale * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
+	M[8] = scale * a3 * (a1 + a3 * a2);
+
+	// Creating a temporary memory to keep the three color channels as floats between the two passes
+	float* tmp = new float[width * height * 3];
+	if (!tmp)
+		return -1;
+
+	// Horizontal pass: every row is filtered forward, then backward.
+	// If the boolean openMP is true, this directive is interpreted so that the following for loop
+	// will be run on multiple cores.
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		BYTE* p = inBGR + i * stride;
+		float* t = tmp + i * width * 3;
+		for (int c = 0; c < 3; c++) {
+			// The borders are replicated, so the filter starts in its steady state
+			float w1 = p[c], w2 = p[c], w3 = p[c];
+			for (int j = 0; j < width; j++) {
+				float w = B * p[j * 4 + c] + b1 * w1 + b2 * w2 + b3 * w3;
+				t[j * 3 + c] = w;
+				w3 = w2; w2 = w1; w1 = w;
+			}
+			float y1, y2, y3;
+			BackwardInit(M, B, p[(width - 1) * 4 + c], w1, w2, w3, y1, y2, y3);
+			t[(width - 1) * 3 + c] = y1;
+			for (int j = width - 2; j >= 0; j--) {
+				float y = B * t[j * 3 + c] + b1 * y1 + b2 * y2 + b3 * y3;
+				t[j * 3 + c] = y;
+				y3 = y2; y2 = y1; y1 = y;
+			}
+		}
+	}
+
+	// Vertical pass: the columns are processed by blocks of COLUMN_BLOCK pixels,
+	// the recursion state of the whole block being kept side by side.
+	int blocks = (width + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+#pragma omp parallel for if(openMP)
+	for (int b = 0; b < blocks; ++b) {
+		const int first = b * COLUMN_BLOCK * 3;
+		const int n = (min(width, (b + 1) * COLUMN_BLOCK) - b * COLUMN_BLOCK) * 3;
+		float s1[COLUMN_BLOCK * 3], s2[COLUMN_BLOCK * 3], s3[COLUMN_BLOCK * 3], x[COLUMN_BLOCK * 3];
+
+		// Forward, from the top to the bottom of the picture
+		for (int k = 0; k < n; k++)
+			s1[k] = s2[k] = s3[k] = tmp[first + k];
+		for (int i = 0; i < height; i++) {
+			float* t = tmp + i * width * 3 + first;
+			for (int k = 0; k < n; k++) {
+				float w = B * t[k] + b1 * s1[k] + b2 * s2[k] + b3 * s3[k];
+				if (i == height - 1)
+					x[k] = t[k];
+				t[k] = w;
+				s3[k] = s2[k]; s2[k] = s1[k]; s1[k] = w;
+			}
+		}
+
+		// Backward, from the bottom to the top, writing the results to the output image.
+		// The input values of the last row (x) have been kept aside as the border value.
+		for (int i = height - 1; i >= 0; i--) {
+			float* t = tmp + i * width * 3 + first;
+			BYTE* q = outBGR + i * stride + b * COLUMN_BLOCK * 4;
+			for (int k = 0; k < n; k++) {
+				float y;
+				if (i == height - 1) {
+					BackwardInit(M, B, x[k], s1[k], s2[k], s3[k], y, s2[k], s3[k]);
+				}
+				else {
+					y = B * t[k] + b1 * s1[k] + b2 * s2[k] + b3 * s3[k];
+					s3[k] = s2[k]; s2[k] = s1[k];
+				}
+				s1[k] = y;
+				q[(k / 3) * 4 + k % 3] = y < 0 ? 0 : y > 255 ? 255 : (BYTE)(y + 0.5f);
+			}
+			for (int k = 0; k < n / 3; k++)
+				q[k * 4 + 3] = 255;
+		}
+	}
+
+	// Delete the allocated memory for the temporary picture
+	delete[] tmp;
+	return 0;
+}
+
 extern "C" __declspec(dllexport) int __stdcall GaussianBlur(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
 {
 	// Pack the following structure on one-byte boundaries: smallest possible alignment
@@ -21,28 +150,33 @@ extern "C" __declspec(dllexport) int __stdcall GaussianBlur(BYTE* inBGR, BYTE* o
 	// Reading the input parameters
 	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
 	const int radius_kernel = parameter("radius", 2, arr, nArr);			// Radius of the convolution kernel
+	const int method = parameter("method", 0, arr, nArr);					// 0: direct convolution, 1: recursive filter
+	ClearReport();
 
 	// Creating Gauss matrix
 	const int size = radius_kernel * 2 + 1;
-	double sigma = (size - 1) / 6.0;
+	double sigma = parameter("sigma", (size - 1) / 6.0, arr, nArr);		// Only used by the recursive filter
+
+	// The recursive filter does not need any kernel, its cost is the same whatever sigma is
+	if (method == 1)
+		return RecursiveGaussianBlur(inBGR, outBGR, stride, width, height, sigma, openMP);
+
 	double ** matrix = new double*[size];
 	InitGaussian(matrix, size);
-
-	int radius_x = width / 2;
-	int radius_y = height / 2;
+	Placement* placement = BeginPlacement(arr, nArr, openMP);
 
 	// If the boolean openMP is true, this directive is interpreted so that the following for loop
 	// will be run on multiple cores.
 
-#pragma omp parallel for if(openMP)
+#pragma omp parallel for schedule(static) if(openMP)
 	for (int i = 0; i < height; ++i) {
 		int offset = i * stride;
 		BGRA* p = reinterpret_cast<BGRA*>(inBGR + offset);
 		BGRA* q = reinterpret_cast<BGRA*>(outBGR + offset);
-		int y = radius_y - i;
+		CountBytes(placement, (size + 1) * width * sizeof(BGRA));	// size rows read, one written
 		for (int j = 0; j < width; ++j) {
-			int x = j - radius_x;
-			bool skip = abs(x) > (radius_x - radius_kernel) || abs(y) > (radius_y - radius_kernel);
+			// The kernel reaches radius_kernel pixels on every side of the center pixel
+			bool skip = i < radius_kernel || j < radius_kernel || i >= height - radius_kernel || j >= width - radius_kernel;
 			if (skip)
 				q[j] = p[j];	// if convolution not possible (near the edges)
 			else {
@@ -51,7 +185,7 @@ extern "C" __declspec(dllexport) int __stdcall GaussianBlur(BYTE* inBGR, BYTE* o
 				// Apply the convolution kernel to every applicable pixel of the image
 				for (int jj = 0, dY = -radius_kernel; jj < size; jj++, dY++) {
 					for (int ii = 0, dX = -radius_kernel; ii < size; ii++, dX++) {
-						int index = j + dX + dY * width;
+						int index = j + dX + dY * (stride / 4);
 						// Multiply each element in the local neighboorhood of the center pixel
 						//  by the corresponding element in the convolution kernel
 						// For the three colors
@@ -71,8 +205,9 @@ extern "C" __declspec(dllexport) int __stdcall GaussianBlur(BYTE* inBGR, BYTE* o
 
 	// Delete the allocated memory for the convolution kernel 
 	for (int i = 0;i < size;i++) {
-		delete matrix[i];
+		delete[] matrix[i];
 	}
 	delete[] matrix;
+	EndPlacement(placement);
 	return 0;
 }
@@ -1,7 +1,10 @@
 #include "stdafx.h"
-#include < math.h>
+#include <math.h>
 #include <fstream>
+#include <vector>
 #include "omp.h"
+#include "Statistics.h"
+#include "Placement.h"
 
 using namespace std;
 
@@ -17,10 +20,12 @@ extern "C" __declspec(dllexport) int __stdcall HarrisCornerDetector(BYTE* inBGR,
 
 	// Reading the input parameters
 	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int mode = parameter("auto", 0, arr, nArr);						// 0: fixed threshold, 1: Otsu, 2: percentile
 	const int radius_kernel = parameter("radius", 3, arr, nArr);			// Radius of the convolution kernel
+	ClearReport();
 
-	int radius_x = width / 2;
-	int radius_y = height / 2;
+	// The window reaches radius_kernel pixels on every side of a pixel, and the Sobel operator one more
+	const int reach = radius_kernel + 1;
 
 	// Creating Sobel Kernels
 	double M[2][3][3] = { { { -1,0,1 },{ -2,0,2 },{ -1,0,1 } },{ { -1,-2,-1 },{ 0,0,0 },{ 1,2,1 } } };
@@ -31,7 +36,14 @@ extern "C" __declspec(dllexport) int __stdcall HarrisCornerDetector(BYTE* inBGR,
 	InitGaussian(MGauss, size_kernel);
 
 	// Creating a temporary memory to keep the Grayscale picture
-	BYTE* tmpBGR = new BYTE[stride*height * 4];
+	BYTE* tmpBGR = new BYTE[stride*height];
+	// And, if the threshold is chosen automatically, to keep the score of every pixel
+	float* score = mode ? new float[width*height] : NULL;
+	// With the placement, the threads are pinned and the temporary pictures are first touched by the threads
+	// which process their rows
+	Placement* placement = BeginPlacement(arr, nArr, openMP);
+	FirstTouch(placement, tmpBGR, stride, height, openMP);
+	FirstTouch(placement, score, width * sizeof(float), height, openMP);
 	if (tmpBGR) {
 		// Allocating the needed memory to hold the 3 matrices to store the Sobel results
 		// Each thread will contain one matrix of each, Ix,Iy,Ixy.
@@ -53,35 +65,42 @@ extern "C" __declspec(dllexport) int __stdcall HarrisCornerDetector(BYTE* inBGR,
 		}
 
 		// Converting the picture into a grayscale picture
-		Grayscale(inBGR, tmpBGR, stride, width, height, openMP);
+		Grayscale(inBGR, tmpBGR, stride, width, height, openMP, placement);
+
+		// In automatic mode, the greatest score of each thread is kept in the same loop,
+		// it gives the scale of the histogram without another pass over the scores
+		vector<float> greatest(max_threads, 0);
 
 		// If the boolean openMP is true, this directive is interpreted so that the following for loop
 		// will be run on multiple cores.
-#pragma omp parallel for if(openMP)
+#pragma omp parallel for schedule(static) if(openMP)
 		for (int v = 0; v < height; ++v) {
 			int omp_threads = omp_get_num_threads();
 			auto offset = v * stride;
 			BGRA* p = reinterpret_cast<BGRA*>(tmpBGR + offset);
 			BGRA* q = reinterpret_cast<BGRA*>(outBGR + offset);
+			// Bytes touched: the rows of the grayscale picture read by the kernel, the output row (and the plane row) written
+			CountBytes(placement, ((size_kernel + 2) + 1 + (score ? 1 : 0)) * width * sizeof(BGRA));
 			for (int u = 0; u < width; ++u) {
-				int x = u - radius_x;
-				bool skip = abs(x) > (radius_x - radius_kernel - 1) || abs(radius_y - v) > (radius_y - radius_kernel - 1);
+				bool skip = u < reach || v < reach || u >= width - reach || v >= height - reach;
 				if (skip) {
 					q[u] = BGRA{ 0,0,0,255 };	// if convolution not possible (near the edges)
+					if (score)
+						score[v * width + u] = -1;
 				}
 				else {
 					int id_thread = omp_get_thread_num();
 					// For each pixel of the kernel, apply the Sobel operator
 					for (int y = 0, dy = -radius_kernel; y < size_kernel; y++, dy++) {
 						for (int x = 0, dx = -radius_kernel; x < size_kernel; x++, dx++) {
-							int indexKernel = u + dx + dy * width;
+							int indexKernel = u + dx + dy * (stride / 4);
 							// Application of the Sobel operator
 							double T[2];
 							T[0] = 0;
 							T[1] = 0;
 							for (int yS = 0, dy_S = -1; yS < 3; yS++, dy_S++) {
-								for (int xS = 0, dx_S = 0; xS < 3; xS++, dx_S++) {
-									int indexSobel = indexKernel + dx_S + dy_S * width;
+								for (int xS = 0, dx_S = -1; xS < 3; xS++, dx_S++) {
+									int indexSobel = indexKernel + dx_S + dy_S * (stride / 4);
 									T[0] += p[indexSobel].G * M[0][yS][xS];
 									T[1] += p[indexSobel].G * M[1][yS][xS];
 								}
@@ -117,7 +136,11 @@ extern "C" __declspec(dllexport) int __stdcall HarrisCornerDetector(BYTE* inBGR,
 					double det = Tx * Ty - (Txy*Txy);
 					double trace = (Tx + Ty);
 					double k = det - 0.04*trace*trace;
-					if (k > 100000000)			// Condition for corner detection
+					if (score) {
+						score[v * width + u] = k;	// the threshold is not known yet
+						greatest[id_thread] = max(greatest[id_thread], (float)k);
+					}
+					else if (k > 100000000)			// Condition for corner detection
 						q[u] = BGRA{ 255,255,255,255 };
 					else
 						q[u] = BGRA{ 0,0,0,255 };
@@ -125,26 +148,47 @@ extern "C" __declspec(dllexport) int __stdcall HarrisCornerDetector(BYTE* inBGR,
 			}
 		}
 
+		// Choosing the threshold from the histogram of the scores, then applying it. The scale of the histogram,
+		// the greatest score, is only known at the end of the response loop: the scores are counted in a second pass.
+		if (score) {
+			Histogram hist;
+			float scale = 0;
+			for (int t = 0; t < max_threads; t++)
+				scale = max(scale, greatest[t]);
+			ValueHistogram(score, width*height, scale, openMP, &hist, placement);
+			double level = AutoThreshold(&hist, 100000000, scale, arr, nArr, true);
+#pragma omp parallel for schedule(static) if(openMP)
+			for (int v = 0; v < height; ++v) {
+				BGRA* q = reinterpret_cast<BGRA*>(outBGR + v * stride);
+				CountBytes(placement, 2 * width * sizeof(BGRA));	// the plane row read, the output row written
+				float* k = score + v * width;
+				for (int u = 0; u < width; ++u)
+					q[u] = k[u] > 0 && k[u] >= level ? BGRA{ 255,255,255,255 } : BGRA{ 0,0,0,255 };
+			}
+			delete[] score;
+		}
+
 		// Delete the allocated memory for the convolution kernel and the temporary grayscale image
 		for (int i = 0;i < size_kernel;i++) {
-			delete MGauss[i];
+			delete[] MGauss[i];
 		}
 		delete[] MGauss;
-		delete tmpBGR;
+		delete[] tmpBGR;
 		// And also the allocated matrices for the Sobel operators
-		for (int i = 0; i < size_kernel; i++) {
+		for (int i = 0; i < max_threads; i++) {
 			for (int j = 0; j < size_kernel; j++) {
-				delete Ix[i][j];
-				delete Iy[i][j];
-				delete Ixy[i][j];
+				delete[] Ix[i][j];
+				delete[] Iy[i][j];
+				delete[] Ixy[i][j];
 			}
-			delete Ix[i];
-			delete Iy[i];
-			delete Ixy[i];
+			delete[] Ix[i];
+			delete[] Iy[i];
+			delete[] Ixy[i];
 		}
 		delete[] Ix;
 		delete[] Iy;
 		delete[] Ixy;
 	}
+	EndPlacement(placement);
 	return 0;
 }
@@ -0,0 +1,122 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+// Height of the bands of rows labeled independently by each thread
+#define BAND_HEIGHT 64
+
+// Looks for the root of a set in the union-find forest, compressing the path on the way
+inline int Find(int* parent, int x)
+{
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+// Merges the sets of a and b, the root being the first pixel of the set.
+// A set is marked if one of the two merged sets was marked.
+inline void Union(int* parent, BYTE* marked, int a, int b)
+{
+	a = Find(parent, a);
+	b = Find(parent, b);
+	if (a == b)
+		return;
+	if (a > b)
+		std::swap(a, b);
+	parent[b] = a;
+	marked[a] |= marked[b];
+}
+
+// Labels the sets of connected pixels (8-connectivity) of a picture.
+// mask(i, j) tells for each pixel whether it is part of the background (0), to be labeled (1),
+// or to be labeled and marking its set (2). The mask is read on the fly and never stored.
+// Each band of BAND_HEIGHT rows is flood filled by one thread, then the sets which touch each other
+// across the border of two bands are merged with a union-find.
+// After the call labels[i * width + j] is the index of the first pixel of the set (-1 for the background)
+// and marked[label] tells if the set contains a marking pixel. Returns the number of sets.
+template <class Mask>
+int LabelComponents(Mask mask, int* labels, BYTE* marked, int width, int height, bool omp)
+{
+	const int bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	int* parent = new int[width * height];
+	int* found = new int[bands];
+
+	// Flood filling each band, every set being identified by its first pixel
+#pragma omp parallel for if(omp)
+	for (int b = 0; b < bands; ++b) {
+		const int first = b * BAND_HEIGHT;
+		const int last = min(height, first + BAND_HEIGHT);
+		for (int index = first * width; index < last * width; index++)
+			parent[index] = -1;
+		found[b] = 0;
+		std::vector<int> stack;
+		for (int index = first * width; index < last * width; index++) {
+			if (parent[index] != -1)
+				continue;
+			BYTE m = mask(index / width, index % width);
+			if (!m)
+				continue;
+			// New set, filled from this pixel
+			found[b]++;
+			parent[index] = index;
+			marked[index] = m == 2;
+			stack.push_back(index);
+			while (!stack.empty()) {
+				int current = stack.back();
+				stack.pop_back();
+				int i = current / width, j = current % width;
+				for (int ii = max(i - 1, first); ii <= min(i + 1, last - 1); ii++) {
+					for (int jj = max(j - 1, 0); jj <= min(j + 1, width - 1); jj++) {
+						int neighbor = ii * width + jj;
+						if (parent[neighbor] != -1)
+							continue;
+						BYTE n = mask(ii, jj);
+						if (n) {
+							parent[neighbor] = index;
+							marked[index] |= n == 2;
+							stack.push_back(neighbor);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Merging the sets which touch each other across the border of two bands
+	int count = 0;
+	for (int b = 0; b < bands; ++b)
+		count += found[b];
+	for (int b = 1; b < bands; ++b) {
+		const int i = b * BAND_HEIGHT;
+		for (int j = 0; j < width; j++) {
+			int index = i * width + j;
+			if (parent[index] == -1)
+				continue;
+			for (int jj = max(j - 1, 0); jj <= min(j + 1, width - 1); jj++) {
+				int neighbor = (i - 1) * width + jj;
+				if (parent[neighbor] != -1 && Find(parent, index) != Find(parent, neighbor)) {
+					Union(parent, marked, index, neighbor);
+					count--;
+				}
+			}
+		}
+	}
+
+	// Giving every pixel the label of its root.
+	// The forest is only read here, so the roots are looked for without compressing the paths.
+#pragma omp parallel for if(omp)
+	for (int index = 0; index < width * height; index++) {
+		int root = parent[index];
+		if (root != -1)
+			while (parent[root] != root)
+				root = parent[root];
+		labels[index] = root;
+	}
+
+	delete[] parent;
+	delete[] found;
+	return count;
+}
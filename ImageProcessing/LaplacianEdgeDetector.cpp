@@ -1,6 +1,9 @@
 #include "stdafx.h"
 #include <math.h>
 #include <fstream>
+#include "omp.h"
+#include "Statistics.h"
+#include "Placement.h"
 
 using namespace std;
 
@@ -16,6 +19,8 @@ extern "C" __declspec(dllexport) int __stdcall LaplacianEdgeDetector(BYTE* inBGR
 
 	// Reading the input parameters
 	bool openMP = parameter("openMP", 1, arr, narr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int mode = parameter("auto", 0, arr, narr);						// 0: fixed threshold, 1: Otsu, 2: percentile
+	ClearReport();
 
 	// Setting up the Laplacian Kernel 
 	const int radius = 1;
@@ -23,22 +28,38 @@ extern "C" __declspec(dllexport) int __stdcall LaplacianEdgeDetector(BYTE* inBGR
 	double M[size][size] = { {-1,-1,-1},{-1,8,-1},{ -1,-1,-1} };
 
 	// Creating a temporary memory to keep the Grayscale picture
-	BYTE* tmpBGR = new BYTE[stride*height * 4];
+	BYTE* tmpBGR = new BYTE[stride*height];
+	// And, if the threshold is chosen automatically, to keep the response of every pixel
+	float* response = mode ? new float[width*height] : NULL;
+	// With the placement, the threads are pinned and the temporary pictures are first touched by the threads
+	// which process their rows
+	Placement* placement = BeginPlacement(arr, narr, openMP);
+	FirstTouch(placement, tmpBGR, stride, height, openMP);
+	FirstTouch(placement, response, width * sizeof(float), height, openMP);
 	if (tmpBGR) {
 
 		// Converting the picture into a grayscale picture
-		Grayscale(inBGR, tmpBGR, stride, width, height, openMP);
+		Grayscale(inBGR, tmpBGR, stride, width, height, openMP, placement);
+
+		// In automatic mode, the histogram of the responses is filled in the same loop
+		Histogram* partial = response ? PartialHistograms() : NULL;
 
 		// If the boolean openMP is true, this directive is interpreted so that the following for loop
 		// will be run on multiple cores.
-#pragma omp parallel for if(openMP)
+#pragma omp parallel for schedule(static) if(openMP)
 		for (int i = 0; i < height; ++i) {
 			auto offset = i * stride;
 			BGRA* p = reinterpret_cast<BGRA*>(tmpBGR + offset);
 			BGRA* q = reinterpret_cast<BGRA*>(outBGR + offset);
+			unsigned __int64* bins = partial ? partial[omp_get_thread_num()].bins : NULL;
+			// Bytes touched: the rows of the grayscale picture read by the kernel, the output row (and the plane row) written
+			CountBytes(placement, (size + 1 + (response ? 1 : 0)) * width * sizeof(BGRA));
 			for (int j = 0; j < width; ++j) {
-				if (i == 0 || j == 0 || i == height - 1 || j == width - 1)
+				if (i == 0 || j == 0 || i == height - 1 || j == width - 1) {
 					q[j] = p[j];	// if convolution not possible (near the edges)
+					if (response)
+						response[i * width + j] = -1;
+				}
 				else {
 					double t = 0;
 					// Apply the Laplacian Kernel to every applicable pixel of the image
@@ -48,20 +69,47 @@ extern "C" __declspec(dllexport) int __stdcall LaplacianEdgeDetector(BYTE* inBGR
 					// can provide better results
 					for (int jj = 0, dY = -radius; jj < size; jj++, dY++) {
 						for (int ii = 0, dX = -radius; ii < size; ii++, dX++) {
-							int index = j + dX + dY * width;
+							int index = j + dX + dY * (stride / 4);
 							t += p[index].G * M[ii][jj];
 						}
 					}
-					// Condition for edge detection
+					// Condition for edge detection, or keeping the response until the threshold is known
 					BYTE tmp = t;
-					q[j] = t > 0.20 * 255 ? BGRA{ tmp,tmp,tmp,255 } : BGRA{ 0,0,0,255 };
+					if (response) {
+						response[i * width + j] = t;
+						if (t > 0)
+							bins[t >= 255 ? 255 : (int)t]++;
+					}
+					else
+						q[j] = t > 0.20 * 255 ? BGRA{ tmp,tmp,tmp,255 } : BGRA{ 0,0,0,255 };
+				}
+			}
+		}
+
+		// Choosing the threshold from the histogram of the responses, then applying it
+		if (response) {
+			Histogram hist;
+			MergeHistograms(partial, &hist);
+			double level = AutoThreshold(&hist, 0.20 * 255, 255, arr, narr, true);
+#pragma omp parallel for schedule(static) if(openMP)
+			for (int i = 0; i < height; ++i) {
+				BGRA* q = reinterpret_cast<BGRA*>(outBGR + i * stride);
+				CountBytes(placement, 2 * width * sizeof(BGRA));	// the plane row read, the output row written
+				float* r = response + i * width;
+				for (int j = 0; j < width; ++j) {
+					if (i == 0 || j == 0 || i == height - 1 || j == width - 1)
+						continue;	// near the edges, already written
+					BYTE tmp = r[j];
+					q[j] = r[j] >= level ? BGRA{ tmp,tmp,tmp,255 } : BGRA{ 0,0,0,255 };
 				}
 			}
+			delete[] response;
 		}
 
 		// Delete the allocated memory for the temporary grayscale image
-		delete tmpBGR;
+		delete[] tmpBGR;
 	}
+	EndPlacement(placement);
 	return 0;
 }
 
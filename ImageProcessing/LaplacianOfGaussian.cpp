@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include <fstream>
+#include "Statistics.h"
+#include "Placement.h"
 
 using namespace std;
 
@@ -8,10 +10,17 @@ extern "C" int __stdcall GaussianBlur(BYTE* inBGR, BYTE* outBGR, int stride, int
 
 extern "C" __declspec(dllexport) int __stdcall LaplacianOfGaussian(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
 {
+	// Reading the input parameters
+	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	ClearReport();
 	int rc = -1;
 
-	// Creating a temporary memory to keep the results of the Gaussian Filter
-	BYTE* gauBGR = new BYTE[stride*height * 4];
+	// Creating a temporary memory to keep the results of the Gaussian Filter.
+	// With the placement, its rows are first touched by the threads which blur and then read them,
+	// and both filters are measured as one.
+	BYTE* gauBGR = new BYTE[stride*height];
+	Placement* placement = BeginPlacement(arr, nArr, openMP);
+	FirstTouch(placement, gauBGR, stride, height, openMP);
 	if (gauBGR) {
 		// Apply the Gaussian Blur
 		rc = GaussianBlur(inBGR, gauBGR, stride, width, height, arr, nArr);
@@ -20,8 +29,9 @@ extern "C" __declspec(dllexport) int __stdcall LaplacianOfGaussian(BYTE* inBGR,
 			rc = LaplacianEdgeDetector(gauBGR, outBGR, stride, width, height, arr, nArr);
 
 		// Delete the allocated memory for the temporary Gaussian results
-		delete gauBGR;
+		delete[] gauBGR;
 	}
+	EndPlacement(placement);
 	// Return the status
 	return rc;
 }
@@ -0,0 +1,312 @@
+#include "stdafx.h"
+#include <vector>
+#include "omp.h"
+#include "Statistics.h"
+
+using namespace std;
+
+// Number of pixels processed together by the vertical passes
+#define STRIP_WIDTH 64
+// Greatest number of 64 bits words of a binary mask processed together by the vertical passes
+#define STRIP_WORDS 4
+
+typedef unsigned __int64 WORD64;
+
+// Operations of the running filters, with their identity element (the value of the pixels outside the picture)
+struct MaxByte {
+	BYTE identity() const { return 0; }
+	BYTE operator()(BYTE a, BYTE b) const { return a > b ? a : b; }
+};
+struct MinByte {
+	BYTE identity() const { return 255; }
+	BYTE operator()(BYTE a, BYTE b) const { return a < b ? a : b; }
+};
+struct OrWord {
+	WORD64 identity() const { return 0; }
+	WORD64 operator()(WORD64 a, WORD64 b) const { return a | b; }
+};
+
+// Running maximum (or minimum) over a window of 2r+1 elements, van Herk - Gil-Werman algorithm.
+// The sequence, extended by r identity elements on both sides, is cut into blocks of the size of the window.
+// g holds the running result from the start of each block, h from the end of each block.
+// Any window covers the end of one block and the start of the next one, so its result is op(h[x], g[x + 2r]):
+// three operations per element, whatever the radius.
+// Element e of the sequence is made of lanes values found at src + e * step; all the lanes are processed together.
+template <class T, class Op>
+static void RunningFilter(const T* src, T* dst, int n, int step, int lanes, int r, T* g, T* h, Op op)
+{
+	const int w = 2 * r + 1;
+	const int N = (n + 2 * r + w - 1) / w * w;
+	for (int e = 0; e < N; e++) {
+		int x = e - r;
+		const T* f = (x >= 0 && x < n) ? src + x * step : NULL;
+		T* ge = g + e * lanes;
+		for (int k = 0; k < lanes; k++) {
+			T v = f ? f[k] : op.identity();
+			ge[k] = e % w == 0 ? v : op(ge[k - lanes], v);
+		}
+	}
+	for (int e = N - 1; e >= 0; e--) {
+		int x = e - r;
+		const T* f = (x >= 0 && x < n) ? src + x * step : NULL;
+		T* he = h + e * lanes;
+		for (int k = 0; k < lanes; k++) {
+			T v = f ? f[k] : op.identity();
+			he[k] = e % w == w - 1 ? v : op(he[k + lanes], v);
+		}
+	}
+	for (int x = 0; x < n; x++) {
+		const T* hx = h + x * lanes;
+		const T* gx = g + (x + 2 * r) * lanes;
+		T* d = dst + x * step;
+		for (int k = 0; k < lanes; k++)
+			d[k] = op(hx[k], gx[k]);
+	}
+}
+
+// Erosion or dilation of a BGRA picture by a rectangle of (2rx+1) x (2ry+1) pixels, every channel separately.
+// The rows are filtered in parallel, then the columns by strips of STRIP_WIDTH pixels.
+template <class Op>
+static void MorphBytes(BYTE* in, BYTE* out, int stride, int width, int height, int rx, int ry, Op op, bool openMP)
+{
+	BYTE* tmp = new BYTE[stride * height];
+
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		vector<BYTE> g((width + 4 * rx + 1) * 4), h((width + 4 * rx + 1) * 4);
+		RunningFilter(in + i * stride, tmp + i * stride, width, 4, 4, rx, g.data(), h.data(), op);
+	}
+
+	const int strips = (width + STRIP_WIDTH - 1) / STRIP_WIDTH;
+#pragma omp parallel for if(openMP)
+	for (int s = 0; s < strips; ++s) {
+		const int lanes = (min(width, (s + 1) * STRIP_WIDTH) - s * STRIP_WIDTH) * 4;
+		vector<BYTE> g((height + 4 * ry + 1) * lanes), h((height + 4 * ry + 1) * lanes);
+		RunningFilter(tmp + s * STRIP_WIDTH * 4, out + s * STRIP_WIDTH * 4, height, stride, lanes, ry, g.data(), h.data(), op);
+	}
+
+	delete[] tmp;
+}
+
+// Shifts a row of bits by k positions towards the lower pixels (k > 0) or the higher pixels (k < 0).
+// Pixel j of the row is the bit j % 64 of the word j / 64; the bits coming in are 0.
+static void ShiftBits(const WORD64* src, WORD64* dst, int words, int k)
+{
+	const int offset = (k >= 0 ? k : -k) / 64, bits = (k >= 0 ? k : -k) % 64;
+	for (int i = 0; i < words; i++) {
+		int from = k >= 0 ? i + offset : i - offset;
+		WORD64 a = (from >= 0 && from < words) ? src[from] : 0;
+		WORD64 b;
+		if (k >= 0) {
+			b = (from + 1 < words) ? src[from + 1] : 0;
+			dst[i] = bits ? (a >> bits) | (b << (64 - bits)) : a;
+		}
+		else {
+			b = (from - 1 >= 0 && from - 1 < words) ? src[from - 1] : 0;
+			dst[i] = bits ? (a << bits) | (b >> (64 - bits)) : a;
+		}
+	}
+}
+
+// Grows the bits of a row of a mask by doubling: after each step, the bit j holds the OR of the pixels
+// j to j + span - 1 (direction 1) or j - span + 1 to j (direction -1), until the span is r + 1.
+static void GrowBits(WORD64* p, WORD64* shifted, int words, int r, int direction)
+{
+	int span = 1;
+	while (span < r + 1) {
+		int k = min(span, r + 1 - span);
+		ShiftBits(p, shifted, words, direction * k);
+		for (int w = 0; w < words; w++)
+			p[w] |= shifted[w];
+		span += k;
+	}
+}
+
+// Dilation of a bit-packed mask (words per row) by a rectangle of (2rx+1) x (2ry+1) pixels.
+// On a row, the window is grown towards both sides in log(rx) steps of 64 pixels per operation.
+// The columns are filtered with the running filter, 64 pixels per operation, by strips of at most
+// STRIP_WORDS words, narrower if needed so that every thread gets a strip.
+static void DilateBits(WORD64* in, WORD64* out, int words, int height, int rx, int ry, bool openMP)
+{
+	WORD64* tmp = new WORD64[words * height];
+
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		vector<WORD64> right(in + i * words, in + (i + 1) * words), left(right), shifted(words);
+		GrowBits(right.data(), shifted.data(), words, rx, 1);
+		GrowBits(left.data(), shifted.data(), words, rx, -1);
+		for (int w = 0; w < words; w++)
+			tmp[i * words + w] = right[w] | left[w];
+	}
+
+	const int threads = openMP ? omp_get_max_threads() : 1;
+	const int strip = max(1, min(STRIP_WORDS, words / threads));
+	const int strips = (words + strip - 1) / strip;
+#pragma omp parallel for if(openMP)
+	for (int s = 0; s < strips; ++s) {
+		const int lanes = min(words, (s + 1) * strip) - s * strip;
+		vector<WORD64> g((height + 4 * ry + 1) * lanes), h((height + 4 * ry + 1) * lanes);
+		RunningFilter(tmp + s * strip, out + s * strip, height, words, lanes, ry, g.data(), h.data(), OrWord());
+	}
+
+	delete[] tmp;
+}
+
+// Erosion of a bit-packed mask: the dilation of the complement. The bits after the last pixel of a row
+// are kept to 0 in the complement, so that the outside of the picture does not erode the mask.
+static void ErodeBits(WORD64* in, WORD64* out, int words, int width, int height, int rx, int ry, bool openMP)
+{
+	WORD64 last = width % 64 ? (((WORD64)1 << (width % 64)) - 1) : ~(WORD64)0;
+	WORD64* complement = new WORD64[words * height];
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i)
+		for (int w = 0; w < words; w++)
+			complement[i * words + w] = ~in[i * words + w] & (w == words - 1 ? last : ~(WORD64)0);
+	DilateBits(complement, out, words, height, rx, ry, openMP);
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i)
+		for (int w = 0; w < words; w++)
+			out[i * words + w] = ~out[i * words + w] & (w == words - 1 ? last : ~(WORD64)0);
+	delete[] complement;
+}
+
+// Operations exported by this file
+enum Operation { ERODE, DILATE, OPEN, CLOSE, GRADIENT };
+
+// Common part of the morphological filters. The parameters are:
+//	- "radius", or "radius_x" and "radius_y": half size of the rectangular structuring element
+//	- "binary": if 1, the picture is a mask (every non black pixel is set), packed on one bit per pixel.
+//	  The output is white on black, as the detectors do.
+static int Morphology(Operation operation, BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	// Pack the following structure on one-byte boundaries: smallest possible alignment
+	// This allows to use the minimal memory space for this type: exact fit - no padding
+#pragma pack(push, 1)
+	struct BGRA {
+		BYTE B, G, R, A;
+	};
+#pragma  pack(pop)		// Back to the default packing mode
+
+	// Reading the input parameters
+	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int radius = parameter("radius", 1, arr, nArr);					// Radius of the structuring element
+	const int rx = parameter("radius_x", radius, arr, nArr);
+	const int ry = parameter("radius_y", radius, arr, nArr);
+	const bool binary = parameter("binary", 0, arr, nArr) == 1;			// If the picture is a binary mask
+	ClearReport();
+
+	if (rx < 0 || ry < 0)
+		return -1;
+
+	if (!binary) {
+		BYTE* tmpBGR = new BYTE[stride * height];
+		switch (operation) {
+		case ERODE:
+			MorphBytes(inBGR, outBGR, stride, width, height, rx, ry, MinByte(), openMP);
+			break;
+		case DILATE:
+			MorphBytes(inBGR, outBGR, stride, width, height, rx, ry, MaxByte(), openMP);
+			break;
+		case OPEN:
+			MorphBytes(inBGR, tmpBGR, stride, width, height, rx, ry, MinByte(), openMP);
+			MorphBytes(tmpBGR, outBGR, stride, width, height, rx, ry, MaxByte(), openMP);
+			break;
+		case CLOSE:
+			MorphBytes(inBGR, tmpBGR, stride, width, height, rx, ry, MaxByte(), openMP);
+			MorphBytes(tmpBGR, outBGR, stride, width, height, rx, ry, MinByte(), openMP);
+			break;
+		case GRADIENT:
+			MorphBytes(inBGR, tmpBGR, stride, width, height, rx, ry, MinByte(), openMP);
+			MorphBytes(inBGR, outBGR, stride, width, height, rx, ry, MaxByte(), openMP);
+#pragma omp parallel for if(openMP)
+			for (int i = 0; i < height; ++i) {
+				BGRA* e = reinterpret_cast<BGRA*>(tmpBGR + i * stride);
+				BGRA* q = reinterpret_cast<BGRA*>(outBGR + i * stride);
+				for (int j = 0; j < width; ++j)
+					q[j] = BGRA{ (BYTE)(q[j].B - e[j].B), (BYTE)(q[j].G - e[j].G), (BYTE)(q[j].R - e[j].R), 255 };
+			}
+			break;
+		}
+		delete[] tmpBGR;
+		return 0;
+	}
+
+	// Packing the mask, 64 pixels per word
+	const int words = (width + 63) / 64;
+	WORD64* mask = new WORD64[words * height];
+	WORD64* result = new WORD64[words * height];
+	WORD64* tmp = new WORD64[words * height];
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		BGRA* p = reinterpret_cast<BGRA*>(inBGR + i * stride);
+		WORD64* m = mask + i * words;
+		for (int w = 0; w < words; w++)
+			m[w] = 0;
+		for (int j = 0; j < width; ++j)
+			if (p[j].B | p[j].G | p[j].R)
+				m[j / 64] |= (WORD64)1 << (j % 64);
+	}
+
+	switch (operation) {
+	case ERODE:
+		ErodeBits(mask, result, words, width, height, rx, ry, openMP);
+		break;
+	case DILATE:
+		DilateBits(mask, result, words, height, rx, ry, openMP);
+		break;
+	case OPEN:
+		ErodeBits(mask, tmp, words, width, height, rx, ry, openMP);
+		DilateBits(tmp, result, words, height, rx, ry, openMP);
+		break;
+	case CLOSE:
+		DilateBits(mask, tmp, words, height, rx, ry, openMP);
+		ErodeBits(tmp, result, words, width, height, rx, ry, openMP);
+		break;
+	case GRADIENT:
+		ErodeBits(mask, tmp, words, width, height, rx, ry, openMP);
+		DilateBits(mask, result, words, height, rx, ry, openMP);
+		for (int k = 0; k < words * height; k++)
+			result[k] &= ~tmp[k];
+		break;
+	}
+
+	// Writing the results to the output image
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		BGRA* q = reinterpret_cast<BGRA*>(outBGR + i * stride);
+		WORD64* m = result + i * words;
+		for (int j = 0; j < width; ++j)
+			q[j] = (m[j / 64] >> (j % 64)) & 1 ? BGRA{ 255,255,255,255 } : BGRA{ 0,0,0,255 };
+	}
+
+	// Delete the allocated memory for the masks
+	delete[] mask;
+	delete[] result;
+	delete[] tmp;
+	return 0;
+}
+
+extern "C" __declspec(dllexport) int __stdcall Erode(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	return Morphology(ERODE, inBGR, outBGR, stride, width, height, arr, nArr);
+}
+
+extern "C" __declspec(dllexport) int __stdcall Dilate(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	return Morphology(DILATE, inBGR, outBGR, stride, width, height, arr, nArr);
+}
+
+extern "C" __declspec(dllexport) int __stdcall Open(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	return Morphology(OPEN, inBGR, outBGR, stride, width, height, arr, nArr);
+}
+
+extern "C" __declspec(dllexport) int __stdcall Close(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	return Morphology(CLOSE, inBGR, outBGR, stride, width, height, arr, nArr);
+}
+
+extern "C" __declspec(dllexport) int __stdcall Gradient(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+{
+	return Morphology(GRADIENT, inBGR, outBGR, stride, width, height, arr, nArr);
+}
@@ -11,4 +11,21 @@ struct KVP {
 	double value;		// contains the value of the parameter
 };
 
+// The following structure describes a convolution kernel chosen by the client, given to Convolve.
+
+struct Kernel {
+	int width, height;		// size of the kernel, odd numbers (the center of the kernel is the center pixel)
+	const double* values;	// width * height coefficients, row by row
+};
+
+// The following structure describes one connected set of pixels found by ConnectedComponents.
+// The client receives the table of every set found with the ComponentTable function.
+
+struct Component {
+	int label;			// label of the set in the output picture, from 1 (0 is the background)
+	int area;			// number of pixels of the set
+	int left, top;		// bounding box of the set, inclusive
+	int right, bottom;
+};
+
 double parameter(const char* name, double defValue, KVP* arr, int nArr);
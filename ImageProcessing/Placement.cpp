@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include "omp.h"
+#include "Timer.h"
+#include "Statistics.h"
+#include "Placement.h"
+
+using namespace std;
+
+// Size of a cache line
+#define CACHE_LINE 64
+
+// Bytes counted by one thread, alone on its cache line so that the threads of different nodes do not share lines
+struct alignas(CACHE_LINE) Counter {
+	unsigned __int64 bytes;
+};
+
+// Context of a placed section
+struct Placement {
+	int depth;							// number of nested filters using the context
+	int threads;						// size of the team which was pinned
+	vector<GROUP_AFFINITY> previous;	// affinity of every thread before it was pinned
+	vector<BYTE> counterMemory;			// memory of the counters, one cache line more than needed
+	Counter* counters;					// bytes counted by every thread, from the first cache line of counterMemory
+	Timer timer;
+
+	Placement() : depth(1), threads(0), counters(NULL), timer(Timer::NS) {}
+};
+
+// Processors of every node, found the first time a placement is used, and never changed after
+static vector<GROUP_AFFINITY> nodes;
+static once_flag nodesFound;
+
+// Placed section the calling (client) thread is in, so that nested filters join it
+static thread_local Placement* current = NULL;
+
+// Looks for the processors of every NUMA node. A system without NUMA is seen as one node.
+static void InitNodes()
+{
+	ULONG highest = 0;
+	if (!GetNumaHighestNodeNumber(&highest))
+		highest = 0;
+	for (ULONG n = 0; n <= highest; n++) {
+		GROUP_AFFINITY affinity = {};
+		if (GetNumaNodeProcessorMaskEx((USHORT)n, &affinity) && affinity.Mask)
+			nodes.push_back(affinity);
+	}
+}
+
+// Node of a thread: thread t of T runs on the node t * N / T
+static int NodeOfThread(int thread, int threads)
+{
+	return (int)((__int64)thread * nodes.size() / threads);
+}
+
+// Processor given to a thread: the threads of a node take its processors in order
+// (several threads share a processor if there are more threads than processors).
+static GROUP_AFFINITY ThreadAffinity(int thread, int threads)
+{
+	const int n = (int)nodes.size();
+	const int node = NodeOfThread(thread, threads);
+	const int first = (node * threads + n - 1) / n;		// first thread of the node
+	GROUP_AFFINITY affinity = nodes[node];
+
+	int processors = 0;
+	for (KAFFINITY m = affinity.Mask; m; m &= m - 1)
+		processors++;
+	int k = (thread - first) % processors;
+	KAFFINITY m = affinity.Mask;
+	for (; k > 0; k--)
+		m &= m - 1;
+	affinity.Mask = m & (~m + 1);	// lowest bit left
+	return affinity;
+}
+
+Placement* BeginPlacement(KVP* arr, int nArr, bool omp)
+{
+	if (current) {
+		current->depth++;
+		return current;
+	}
+	if (!omp || parameter("placement", 0, arr, nArr) != 1)
+		return NULL;
+
+	call_once(nodesFound, InitNodes);
+	if (nodes.empty())
+		return NULL;
+
+	Placement* placement = new Placement;
+	const int threads = omp_get_max_threads();
+	placement->threads = threads;
+	placement->previous.assign(threads, GROUP_AFFINITY());
+	// The allocator only guarantees the alignment of the fundamental types: the counters start on the first
+	// cache line boundary of a buffer one line longer than needed
+	placement->counterMemory.assign((threads + 1) * sizeof(Counter), 0);
+	uintptr_t first = (reinterpret_cast<uintptr_t>(placement->counterMemory.data()) + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+	placement->counters = reinterpret_cast<Counter*>(first);
+
+	// Pinning every thread of the team. The same threads run the next parallel loops of the filter.
+#pragma omp parallel num_threads(threads)
+	{
+		const int t = omp_get_thread_num();
+		GROUP_AFFINITY affinity = ThreadAffinity(t, threads);
+		SetThreadGroupAffinity(GetCurrentThread(), &affinity, &placement->previous[t]);
+	}
+
+	current = placement;
+	placement->timer.start();
+	return placement;
+}
+
+void EndPlacement(Placement* placement)
+{
+	if (!placement || --placement->depth > 0)
+		return;
+	const double seconds = max(1.0, (double)placement->timer.elapsed64()) / 1e9;
+	const int threads = placement->threads;
+
+	// Giving the threads back their previous affinity
+#pragma omp parallel num_threads(threads)
+	{
+		const int t = omp_get_thread_num();
+		SetThreadGroupAffinity(GetCurrentThread(), &placement->previous[t], NULL);
+	}
+
+	// Reporting the bytes read and written by the threads of every node
+	const int n = (int)nodes.size();
+	vector<unsigned __int64> bytes(n, 0);
+	for (int t = 0; t < threads; t++)
+		bytes[NodeOfThread(t, threads)] += placement->counters[t].bytes;
+	Report("nodes", n);
+	for (int node = 0; node < n; node++) {
+		string name = "node" + to_string(node);
+		Report((name + ".bytes").c_str(), (double)bytes[node]);
+		Report((name + ".bandwidth").c_str(), bytes[node] / seconds);
+	}
+
+	current = NULL;
+	delete placement;
+}
+
+void FirstTouch(Placement* placement, void* buffer, size_t rowBytes, int rows, bool omp)
+{
+	if (!placement || !buffer)
+		return;
+	BYTE* p = reinterpret_cast<BYTE*>(buffer);
+#pragma omp parallel for schedule(static) if(omp)
+	for (int i = 0; i < rows; ++i)
+		memset(p + i * rowBytes, 0, rowBytes);
+}
+
+void CountBytes(Placement* placement, size_t bytes)
+{
+	if (!placement)
+		return;
+	const int t = omp_get_thread_num();
+	if (t < placement->threads)
+		placement->counters[t].bytes += bytes;
+}
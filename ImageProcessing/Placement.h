@@ -0,0 +1,32 @@
+#pragma once
+
+// Placement of the worker threads on NUMA systems, enabled by the "placement" parameter.
+// Every OpenMP thread is pinned to one processor, the threads being given to the nodes in order:
+// on two nodes, the first half of the threads runs on the first node and the second half on the other one.
+// A parallel loop over the rows with schedule(static) gives each thread a contiguous range of rows,
+// so each node processes one contiguous range of rows. The temporary pictures are first touched with
+// the same partitioning, so that their pages are allocated in the memory of the node which uses them.
+// The processors are given as (group, mask) pairs, so the threads can be placed on more than 64 processors.
+//
+// All the state of a placement lives in its context, created for one call to a filter: filters called
+// at the same time from several client threads do not share anything. A filter called by another filter
+// on the same client thread (GaussianBlur inside LaplacianOfGaussian) joins the context of its caller.
+struct Placement;
+
+// Starts a placed section if the "placement" parameter is 1 and openMP is used: pins the threads
+// and creates the counters. If the calling thread is already in a placed section, joins it.
+// Returns the context of the placement, or NULL if the placement is not active.
+Placement* BeginPlacement(KVP* arr, int nArr, bool omp);
+
+// Ends a placed section. At the end of the outermost one, the threads get back their previous affinity,
+// the context is deleted, and the number of nodes ("nodes") and for every node the bytes read and written
+// by its threads ("node0.bytes", ...) and the bandwidth in bytes per second ("node0.bandwidth", ...) are reported.
+// Does nothing if placement is NULL.
+void EndPlacement(Placement* placement);
+
+// Writes zeros to the rows of a buffer with the same static partitioning as the loops over the rows,
+// so that each page is allocated on the node of the thread which will use it. Does nothing if placement is NULL.
+void FirstTouch(Placement* placement, void* buffer, size_t rowBytes, int rows, bool omp);
+
+// Counts bytes read or written by the calling thread of the team. Does nothing if placement is NULL.
+void CountBytes(Placement* placement, size_t bytes);
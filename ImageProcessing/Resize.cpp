@@ -0,0 +1,165 @@
+#include "stdafx.h"
+#include <math.h>
+#include <vector>
+#include "Statistics.h"
+
+using namespace std;
+
+// Filters Resize can use, chosen with the "filter" parameter
+enum Filter { BILINEAR = 0, BICUBIC = 1, LANCZOS = 2, GAUSSIAN = 3 };
+
+// Value of the filter at a distance x (in source pixels, or in output pixels when downscaling)
+static double Weight(int filter, double x, double sigma)
+{
+	const double pi = acos(-1.0);
+	x = fabs(x);
+	switch (filter) {
+	case BILINEAR:
+		return x < 1 ? 1 - x : 0;
+	case BICUBIC: {
+		// Catmull-Rom spline (a = -0.5)
+		const double a = -0.5;
+		if (x < 1)
+			return (a + 2) * x*x*x - (a + 3) * x*x + 1;
+		if (x < 2)
+			return a * x*x*x - 5 * a * x*x + 8 * a * x - 4 * a;
+		return 0;
+	}
+	case LANCZOS:
+		if (x == 0)
+			return 1;
+		if (x < 3)
+			return 3 * sin(pi * x) * sin(pi * x / 3) / (pi * pi * x * x);
+		return 0;
+	default:
+		return exp(-x * x / (2 * sigma * sigma));
+	}
+}
+
+// Half width of the filter
+static double Support(int filter, double sigma)
+{
+	switch (filter) {
+	case BILINEAR:
+		return 1;
+	case BICUBIC:
+		return 2;
+	case LANCZOS:
+		return 3;
+	default:
+		return 3 * sigma;
+	}
+}
+
+// Coefficients of one direction of the resampling, computed once for every output row or column:
+// output element i is the sum of weights[i * taps + k] times the source element index[i * taps + k].
+// The source indices are clamped, so the borders are replicated.
+struct Coefficients {
+	int taps;
+	vector<int> index;
+	vector<float> weights;
+};
+
+static void InitCoefficients(Coefficients& c, int in, int out, int filter, double sigma, bool antialias)
+{
+	// When downscaling, the filter is stretched so that every source pixel contributes (antialiasing).
+	// The Gaussian filter is already expressed in source pixels, it blurs and resamples at the same time.
+	double scale = (double)out / in;
+	double stretch = (antialias && scale < 1 && filter != GAUSSIAN) ? 1 / scale : 1;
+	double support = Support(filter, sigma) * stretch;
+	c.taps = (int)ceil(support) * 2 + 1;
+	c.index.resize(out * c.taps);
+	c.weights.resize(out * c.taps);
+	vector<double> w(c.taps);
+
+	for (int i = 0; i < out; i++) {
+		// Position of the center of the output element in the source
+		double center = (i + 0.5) / scale - 0.5;
+		int first = (int)floor(center) - c.taps / 2;
+		double total = 0;
+		for (int k = 0; k < c.taps; k++) {
+			w[k] = Weight(filter, (first + k - center) / stretch, sigma);
+			c.index[i * c.taps + k] = min(max(first + k, 0), in - 1);
+			total += w[k];
+		}
+		// If every weight is 0 (a Gaussian so narrow that it underflows between the source pixels),
+		// the nearest source element is taken
+		if (total == 0) {
+			const int nearest = min(max((int)floor(center + 0.5) - first, 0), c.taps - 1);
+			w[nearest] = total = 1;
+		}
+		// Normalizing so that the sum of every weight is 1, in double precision so that tiny weights do not vanish first
+		for (int k = 0; k < c.taps; k++)
+			c.weights[i * c.taps + k] = (float)(w[k] / total);
+	}
+}
+
+// Resizes the picture into an output picture of outWidth x outHeight pixels, outStride bytes per row.
+// Unlike the other filters the output does not have the size of the input, so the caller gives the size
+// of the buffer it allocated; a size which does not fit is rejected. Two separable passes: horizontal, then vertical.
+extern "C" __declspec(dllexport) int __stdcall Resize(BYTE* inBGR, int stride, int width, int height, BYTE* outBGR, int outStride, int outWidth, int outHeight, KVP* arr, int nArr)
+{
+	// Reading the input parameters
+	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int filter = parameter("filter", BILINEAR, arr, nArr);			// 0: bilinear, 1: bicubic, 2: Lanczos, 3: Gaussian
+	const bool antialias = parameter("antialias", 1, arr, nArr) == 1;		// If the filter is stretched when downscaling
+	const int radius = parameter("radius", 2, arr, nArr);					// Radius of the Gaussian filter, as for GaussianBlur
+	const double sigma = parameter("sigma", radius / 3.0, arr, nArr);
+	ClearReport();
+
+	if (!inBGR || !outBGR || width <= 0 || height <= 0 || stride < width * 4 || outWidth <= 0 || outHeight <= 0
+		|| outStride < outWidth * 4 || (filter == GAUSSIAN && sigma <= 0))
+		return -1;
+
+	// Computing the coefficients of every output column and row
+	Coefficients cx, cy;
+	InitCoefficients(cx, width, outWidth, filter, sigma, antialias);
+	InitCoefficients(cy, height, outHeight, filter, sigma, antialias);
+
+	// Horizontal pass: every source row is resampled to the output width, 4 floats per pixel.
+	float* tmp = new float[outWidth * height * 4];
+	if (!tmp)
+		return -1;
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < height; ++i) {
+		BYTE* p = inBGR + i * stride;
+		float* t = tmp + i * outWidth * 4;
+		for (int j = 0; j < outWidth; ++j) {
+			const int* index = &cx.index[j * cx.taps];
+			const float* weights = &cx.weights[j * cx.taps];
+			float acc[4] = { 0, 0, 0, 0 };
+			for (int k = 0; k < cx.taps; k++) {
+				BYTE* s = p + index[k] * 4;
+				for (int c = 0; c < 4; c++)
+					acc[c] += weights[k] * s[c];
+			}
+			for (int c = 0; c < 4; c++)
+				t[j * 4 + c] = acc[c];
+		}
+	}
+
+	// Vertical pass: every output row is a weighted sum of whole rows of the horizontal results,
+	// a contiguous loop the compiler can vectorize.
+#pragma omp parallel for if(openMP)
+	for (int i = 0; i < outHeight; ++i) {
+		const int* index = &cy.index[i * cy.taps];
+		const float* weights = &cy.weights[i * cy.taps];
+		vector<float> acc(outWidth * 4, 0);
+		for (int k = 0; k < cy.taps; k++) {
+			const float* t = tmp + index[k] * outWidth * 4;
+			const float w = weights[k];
+			for (int n = 0; n < outWidth * 4; n++)
+				acc[n] += w * t[n];
+		}
+		// Writing the results to the output image, rounding and clamping every channel
+		BYTE* q = outBGR + i * outStride;
+		for (int n = 0; n < outWidth * 4; n++) {
+			float v = acc[n];
+			q[n] = v < 0 ? 0 : v > 255 ? 255 : (BYTE)(v + 0.5f);
+		}
+	}
+
+	// Delete the allocated memory for the temporary picture
+	delete[] tmp;
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include <math.h>
 #include <fstream>
+#include "Placement.h"
 
 void InitGaussian(double** tab, double size)
 {
@@ -14,7 +15,7 @@ void InitGaussian(double** tab, double size)
 
 	// Allocating the memory
 	for (int i = 0;i < size;i++) {
-		tab[i] = new double[size];
+		tab[i] = new double[(int)size];
 	}
 
 	// Calculating each element of the kernel
@@ -37,19 +38,20 @@ void InitGaussian(double** tab, double size)
 
 }
 
-void Grayscale(BYTE* in, BYTE* out, int stride, int width, int height, bool omp) {
+void Grayscale(BYTE* in, BYTE* out, int stride, int width, int height, bool omp, Placement* placement) {
 
 	// If the boolean omp is true, this directive is interpreted so that the following for loop
 	// will be run on multiple cores.
-#pragma omp parallel for if(omp)
+#pragma omp parallel for schedule(static) if(omp)
 	// For each pixel of the picture applying a formula to convert a RGB image to a Grayscale one
 	// Every pixel will get the same value for Blue, Green and Red
 	for (int i = 0; i < height; i++) {
 		auto offset = i * stride;
 		BGRA* p = reinterpret_cast<BGRA*>(in + offset);
 		BGRA* tmp = reinterpret_cast<BGRA*>(out + offset);
+		CountBytes(placement, 2 * width * sizeof(BGRA));
 		for (int j = 0; j < width; j++) {
-			BYTE same = (0.299 * p[j].R) + (0.587 * p[j].G) + (0.114 * p[j].B);
+			BYTE same = Luminance(p[j]);
 			tmp[j] = BGRA{ same,same,same,255 };
 		}
 	}
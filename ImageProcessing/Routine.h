@@ -1,13 +1,23 @@
 #pragma once
 
+struct Placement;
+
 struct BGRA {
 	BYTE B, G, R, A;
 };
 
+// Relative luminance of a pixel, used to convert to grayscale and for thresholding.
+// Works with any structure having R, G and B members.
+template <class Pixel>
+inline double Luminance(const Pixel& p) {
+	return (0.299 * p.R) + (0.587 * p.G) + (0.114 * p.B);
+}
+
 // For the Gaussian Blur. Initializes an array of double which represents the Gaussian kernel.
 // This kernel will be applied to the picture.
 void InitGaussian(double** tab, double size);
 
 // Converts a BGRA picture into a Grayscale picture. This is needed for some filtering techniques.
 // It can be executed on multiple cores if the omp parameter is set to true.
-void Grayscale(BYTE* in, BYTE* out, int stride, int width, int height, bool omp);
\ No newline at end of file
+// The bytes read and written are counted in the placement of the calling filter, if any.
+void Grayscale(BYTE* in, BYTE* out, int stride, int width, int height, bool omp, Placement* placement = NULL);
\ No newline at end of file
@@ -2,6 +2,9 @@
 #include "stdafx.h"
 #include <math.h>
 #include <fstream>
+#include "omp.h"
+#include "Statistics.h"
+#include "Placement.h"
 
 using namespace std;
 
@@ -18,6 +21,8 @@ extern "C" __declspec(dllexport) int __stdcall SobelEdgeDetector(BYTE* inBGR, BY
 
 	// Reading the input parameters
 	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int mode = parameter("auto", 0, arr, nArr);						// 0: fixed threshold, 1: Otsu, 2: percentile
+	ClearReport();
 
 	// Creating Sobel Kernels
 	const int radius = 1;
@@ -25,29 +30,45 @@ extern "C" __declspec(dllexport) int __stdcall SobelEdgeDetector(BYTE* inBGR, BY
 	double M[2][size][size] = { { { 1,0,-1 },{ 2,0,-2 },{ 1,0,-1 } },{ { 1,2,1 },{ 0,0,0 },{ -1,-2,-1 } } };
 
 	// Creating a temporary memory to keep the Grayscale picture
-	BYTE* tmpBGR = new BYTE[stride*height * 4];
+	BYTE* tmpBGR = new BYTE[stride*height];
+	// And, if the threshold is chosen automatically, to keep the magnitude of every pixel
+	float* magnitude = mode ? new float[width*height] : NULL;
+	// With the placement, the threads are pinned and the temporary pictures are first touched by the threads
+	// which process their rows
+	Placement* placement = BeginPlacement(arr, nArr, openMP);
+	FirstTouch(placement, tmpBGR, stride, height, openMP);
+	FirstTouch(placement, magnitude, width * sizeof(float), height, openMP);
 	if (tmpBGR) {
 
 		// Converting the image to a grayscale picture.
-		Grayscale(inBGR, tmpBGR, stride, width, height, openMP);
+		Grayscale(inBGR, tmpBGR, stride, width, height, openMP, placement);
+
+		// In automatic mode, the histogram of the magnitudes is filled in the same loop
+		Histogram* partial = magnitude ? PartialHistograms() : NULL;
 
 		// If the boolean openMP is true, this directive is interpreted so that the following for loop
 		// will be run on multiple cores.
-#pragma omp parallel for if(openMP)
+#pragma omp parallel for schedule(static) if(openMP)
 		for (int i = 0; i < height; ++i) {
 			auto offset = i * stride;
 			BGRA* p = reinterpret_cast<BGRA*>(tmpBGR + offset);
 			BGRA* q = reinterpret_cast<BGRA*>(outBGR + offset);
+			unsigned __int64* bins = partial ? partial[omp_get_thread_num()].bins : NULL;
+			// Bytes touched: the rows of the grayscale picture read by the kernel, the output row (and the plane row) written
+			CountBytes(placement, (size + 1 + (magnitude ? 1 : 0)) * width * sizeof(BGRA));
 			for (int j = 0; j < width; ++j) {
-				if (i == 0 || j == 0 || i == height - 1 || j == width - 1)
+				if (i == 0 || j == 0 || i == height - 1 || j == width - 1) {
 					q[j] = p[j];	// if convolution not possible (near the edges)
+					if (magnitude)
+						magnitude[i * width + j] = -1;
+				}
 				else {
 					double _T[2];
 					_T[0] = 0; _T[1] = 0;
 					// Applying the two Sobel operators (dX dY) to every applicable pixel
 					for (int jj = 0, dY = -radius; jj < size; jj++, dY++) {
 						for (int ii = 0, dX = -radius; ii < size; ii++, dX++) {
-							int index = j + dX + dY * width;
+							int index = j + dX + dY * (stride / 4);
 							// Multiplicating each pixel in the neighborhood by the two Sobel Operators
 							// It calculates the vertical and horizontal derivatives of the image at a point.
 							_T[1] += p[index].G * M[1][ii][jj];
@@ -56,14 +77,41 @@ extern "C" __declspec(dllexport) int __stdcall SobelEdgeDetector(BYTE* inBGR, BY
 					}
 					// Then is calculated the magnitude of the derivatives
 					BYTE a = sqrt((_T[0] * _T[0]) + (_T[1] * _T[1]));
-					// Condition for edge detection
-					q[j] = a > 0.20 * 255 ? BGRA{ a,a,a,255 } : BGRA{ 0,0,0,255 };
+					// Condition for edge detection, or keeping the magnitude until the threshold is known
+					if (magnitude) {
+						magnitude[i * width + j] = a;
+						if (a > 0)
+							bins[a]++;
+					}
+					else
+						q[j] = a > 0.20 * 255 ? BGRA{ a,a,a,255 } : BGRA{ 0,0,0,255 };
+				}
+			}
+		}
+
+		// Choosing the threshold from the histogram of the magnitudes, then applying it
+		if (magnitude) {
+			Histogram hist;
+			MergeHistograms(partial, &hist);
+			double level = AutoThreshold(&hist, 0.20 * 255, 255, arr, nArr);
+#pragma omp parallel for schedule(static) if(openMP)
+			for (int i = 0; i < height; ++i) {
+				BGRA* q = reinterpret_cast<BGRA*>(outBGR + i * stride);
+				CountBytes(placement, 2 * width * sizeof(BGRA));	// the plane row read, the output row written
+				float* m = magnitude + i * width;
+				for (int j = 0; j < width; ++j) {
+					if (m[j] < 0)
+						continue;	// near the edges, already written
+					BYTE a = m[j];
+					q[j] = a > level ? BGRA{ a,a,a,255 } : BGRA{ 0,0,0,255 };
 				}
 			}
+			delete[] magnitude;
 		}
 
 		//Delete the allocated memory for the temporary grayscale image
-		delete tmpBGR;
+		delete[] tmpBGR;
 	}
+	EndPlacement(placement);
 	return 0;
 }
@@ -0,0 +1,197 @@
+#include "stdafx.h"
+#include <map>
+#include <omp.h>
+#include "Statistics.h"
+#include "Placement.h"
+
+using namespace std;
+
+// Values reported by the last filter, by name. Each client thread has its own values, so that filters
+// called at the same time from several threads do not overwrite each other's values. The values are
+// always reported by the thread which called the filter, never from a parallel region.
+static thread_local map<string, double> reported;
+
+// Resets a histogram before it is filled
+static void ClearHistogram(Histogram* hist)
+{
+	memset(hist->bins, 0, sizeof(hist->bins));
+	hist->count = 0;
+	hist->min = 255;
+	hist->max = 0;
+	hist->mean = 0;
+}
+
+Histogram* PartialHistograms()
+{
+	int max_threads = omp_get_max_threads();
+	Histogram* partial = new Histogram[max_threads];
+	for (int t = 0; t < max_threads; t++)
+		ClearHistogram(&partial[t]);
+	return partial;
+}
+
+void MergeHistograms(Histogram* partial, Histogram* hist)
+{
+	int max_threads = omp_get_max_threads();
+	ClearHistogram(hist);
+	for (int t = 0; t < max_threads; t++)
+		for (int i = 0; i < 256; i++)
+			hist->bins[i] += partial[t].bins[i];
+	double sum = 0;
+	for (int i = 0; i < 256; i++) {
+		if (hist->bins[i]) {
+			hist->min = min(hist->min, i);
+			hist->max = max(hist->max, i);
+			sum += (double)i * hist->bins[i];
+			hist->count += hist->bins[i];
+		}
+	}
+	hist->mean = hist->count ? sum / hist->count : 0;
+	delete[] partial;
+}
+
+void LuminanceHistogram(BYTE* in, int stride, int width, int height, bool omp, Histogram* hist)
+{
+	// One partial histogram for each thread the machine can create
+	Histogram* partial = PartialHistograms();
+
+	// If the boolean omp is true, this directive is interpreted so that the following for loop
+	// will be run on multiple cores.
+#pragma omp parallel for if(omp)
+	for (int i = 0; i < height; i++) {
+		unsigned __int64* bins = partial[omp_get_thread_num()].bins;
+		BGRA* p = reinterpret_cast<BGRA*>(in + i * stride);
+		for (int j = 0; j < width; j++)
+			bins[(BYTE)Luminance(p[j])]++;
+	}
+	MergeHistograms(partial, hist);
+}
+
+float ValueHistogram(const float* values, int n, float scale, bool omp, Histogram* hist, Placement* placement)
+{
+	int max_threads = omp_get_max_threads();
+	Histogram* partial = PartialHistograms();
+
+	// Looking for the greatest value, each thread keeping its own maximum
+	if (scale <= 0) {
+		float* greatest = new float[max_threads];
+		for (int t = 0; t < max_threads; t++)
+			greatest[t] = 0;
+#pragma omp parallel for if(omp)
+		for (int i = 0; i < n; i++) {
+			int id_thread = omp_get_thread_num();
+			if (values[i] > greatest[id_thread])
+				greatest[id_thread] = values[i];
+		}
+		for (int t = 0; t < max_threads; t++)
+			scale = max(scale, greatest[t]);
+		delete[] greatest;
+	}
+
+	float k = scale > 0 ? 255 / scale : 0;
+#pragma omp parallel if(omp)
+	{
+		unsigned __int64* bins = partial[omp_get_thread_num()].bins;
+		size_t read = 0;
+#pragma omp for schedule(static)
+		for (int i = 0; i < n; i++) {
+			read++;
+			if (values[i] <= 0)
+				continue;
+			float v = values[i] * k;
+			int bin = v >= 255 ? 255 : (int)v;
+			bins[bin]++;
+		}
+		CountBytes(placement, read * sizeof(float));
+	}
+
+	MergeHistograms(partial, hist);
+	return scale;
+}
+
+int Percentile(const Histogram* hist, double p)
+{
+	unsigned __int64 target = (unsigned __int64)(p * hist->count);
+	unsigned __int64 total = 0;
+	for (int i = 0; i < 256; i++) {
+		total += hist->bins[i];
+		if (total > target)
+			return i;
+	}
+	return 255;
+}
+
+int Otsu(const Histogram* hist)
+{
+	// Looking for the bin maximizing the variance between the two classes
+	double sum = hist->mean * hist->count;
+	double sumBackground = 0, weightBackground = 0;
+	double best = -1;
+	int threshold = 0;
+	for (int i = 0; i < 256; i++) {
+		weightBackground += hist->bins[i];
+		if (weightBackground == 0)
+			continue;
+		double weightForeground = hist->count - weightBackground;
+		if (weightForeground == 0)
+			break;
+		sumBackground += (double)i * hist->bins[i];
+		double meanBackground = sumBackground / weightBackground;
+		double meanForeground = (sum - sumBackground) / weightForeground;
+		double between = weightBackground * weightForeground * (meanBackground - meanForeground) * (meanBackground - meanForeground);
+		if (between > best) {
+			best = between;
+			threshold = i;
+		}
+	}
+	return threshold;
+}
+
+double AutoThreshold(const Histogram* hist, double fixed, double scale, KVP* arr, int nArr, bool quantized)
+{
+	// Reading the input parameters
+	const int mode = parameter("auto", 0, arr, nArr);						// 0: fixed, 1: Otsu, 2: percentile
+	const double percentile = parameter("percentile", 0.9, arr, nArr);	// Fraction of the values under the threshold
+
+	// The chosen bin and the bins under it are the background
+	const int edge = quantized ? 1 : 0;
+	double threshold = fixed;
+	if (mode == 1)
+		threshold = (Otsu(hist) + edge) * scale / 255;
+	else if (mode == 2)
+		threshold = (Percentile(hist, percentile) + edge) * scale / 255;
+
+	Report("min", hist->min * scale / 255);
+	Report("max", hist->max * scale / 255);
+	Report("mean", hist->mean * scale / 255);
+	Report("median", Percentile(hist, 0.5) * scale / 255);
+	Report("threshold", threshold);
+	return threshold;
+}
+
+void Report(const char* key, double value)
+{
+	reported[key] = value;
+}
+
+void ClearReport()
+{
+	reported.clear();
+	ClearComponents();
+}
+
+// Gives back to the client the values reported by the last filter called by the calling thread.
+// For every KVP of the array, the value is replaced by the reported value of the same name, if any.
+// Returns the number of values found.
+extern "C" __declspec(dllexport) int __stdcall Statistics(KVP* arr, int nArr)
+{
+	int found = 0;
+	for (int i = 0; i < nArr; i++) {
+		auto it = reported.find(arr[i].key);
+		if (it != reported.end()) {
+			arr[i].value = it->second;
+			found++;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+struct Placement;
+
+// Histogram of 8 bits values (luminance or quantized filter responses) and its main statistics.
+// The histograms are computed in parallel: every thread fills its own partial histogram,
+// and the partial histograms are merged at the end.
+struct Histogram {
+	unsigned __int64 bins[256];
+	unsigned __int64 count;
+	int min, max;
+	double mean;
+};
+
+// Computes the histogram of the luminance of the picture, with the same formula as Grayscale
+void LuminanceHistogram(BYTE* in, int stride, int width, int height, bool omp, Histogram* hist);
+
+// Computes the histogram of a plane of n values, quantized on 256 bins between 0 and scale.
+// Only the positive values are counted: the borders (-1) and the flat areas (0) of a response plane
+// would otherwise make most of the histogram. Values greater than scale go to the last bin.
+// If scale is not positive, the greatest value of the plane is used. Returns the scale used.
+// The bytes read are counted in the placement of the calling filter, if any.
+float ValueHistogram(const float* values, int n, float scale, bool omp, Histogram* hist, Placement* placement = NULL);
+
+// Creates one empty partial histogram for each thread the machine can create, for the filters which fill
+// the histogram of their responses in the loop computing them: the bins of thread t are partial[t].bins.
+Histogram* PartialHistograms();
+
+// Merges the partial histograms created by PartialHistograms into hist, computes its statistics and deletes them
+void MergeHistograms(Histogram* partial, Histogram* hist);
+
+// Returns the bin under which a fraction p (between 0 and 1) of the values are found
+int Percentile(const Histogram* hist, double p);
+
+// Returns the bin which best separates the histogram in two classes (Otsu's method)
+int Otsu(const Histogram* hist);
+
+// Chooses a threshold depending on the "auto" input parameter:
+//	- 0: the fixed value given by the caller
+//	- 1: Otsu's method
+//	- 2: the percentile given by the "percentile" parameter (0.9 by default)
+// The threshold is returned in the unit of the values, scale being the value of the last bin (255 for a luminance).
+// For integer values (a luminance, a Sobel magnitude) the values above the chosen bin are kept with a > test.
+// For a plane of float values quantized to the bins (quantized is true), a bin holds the values from its lower edge
+// up to its upper edge: the upper edge of the chosen bin is returned, and the values kept with a >= test.
+// The chosen threshold and the statistics of the histogram are reported.
+double AutoThreshold(const Histogram* hist, double fixed, double scale, KVP* arr, int nArr, bool quantized = false);
+
+// Saves a value computed by the last filter, so that the client can read it with Statistics() from the same thread.
+// Must be called by the thread which called the filter, not from a parallel region.
+void Report(const char* key, double value);
+
+// Forgets the values reported by the previous filter of the calling thread, and the table of the sets it found
+// (ClearComponents). Called at the start of every exported filter, so that Statistics() and ComponentTable()
+// never give back the results of another filter.
+void ClearReport();
+
+// Forgets the table of the sets found by the last call to ConnectedComponents on the calling thread
+void ClearComponents();
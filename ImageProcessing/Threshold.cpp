@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include <fstream>
+#include "Statistics.h"
 
 using namespace std;
 
@@ -16,6 +17,16 @@ extern "C" __declspec(dllexport) int __stdcall Threshold(BYTE* inBGR, BYTE* outB
 	// Reading the input parameters
 	double threshold = parameter("threshold", 0.75, arr, nArr);				// Value for thresholding (%)
 	bool openMP = parameter("openMP", 1, arr, nArr) == 1 ? true : false;	// If openMP should be used for multithreading
+	const int mode = parameter("auto", 0, arr, nArr);						// 0: fixed threshold, 1: Otsu, 2: percentile
+	ClearReport();
+
+	// Choosing the threshold from the luminance histogram of the picture
+	double level = threshold * 255;
+	if (mode) {
+		Histogram hist;
+		LuminanceHistogram(inBGR, stride, width, height, openMP, &hist);
+		level = AutoThreshold(&hist, level, 255, arr, nArr);
+	}
 
 	// Apply the following algorithm to every pixel of the picture
 
@@ -28,9 +39,9 @@ extern "C" __declspec(dllexport) int __stdcall Threshold(BYTE* inBGR, BYTE* outB
 		BGRA* q = reinterpret_cast<BGRA*>(outBGR + offset);
 		for (int j = 0; j < width; ++j) {
 			// Calculation of the relative luminance of each pixel
-			auto Y = (0.299 * p[j].R) + (0.587 * p[j].G) + (0.114 * p[j].B);
+			auto Y = Luminance(p[j]);
 			// Condition for thresholding
-			q[j] = Y > threshold * 255 ? p[j] : BGRA{ 0,0,0,255 };
+			q[j] = Y > level ? p[j] : BGRA{ 0,0,0,255 };
 		}
 	}
 	return 0;
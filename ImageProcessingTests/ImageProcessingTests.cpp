@@ -0,0 +1,586 @@
+// Regression and benchmark tests of the filters exported by ImageProcessing.dll
+//
+// Every exported filter is run on synthetic pictures of odd and even sizes whose rows are padded (the stride is not width * 4):
+//	- once on a single thread (openMP = 0), once on every thread (openMP = 1), and once with the thread placement,
+//	  the three outputs must be the same, byte for byte
+//	- the padding bytes at the end of every output row must not be written
+//	- the output must match the signature stored in Golden.txt: the mean of every channel on a 4x4 grid of blocks,
+//	  within a tolerance, so that the rounding of another compiler does not fail the test
+// The behaviour of the filters is also checked against what they should compute, whatever the compiler:
+//	- the strategies of Convolve (direct, separable, sparse, Fourier) give the same result within 1
+//	- Threshold keeps exactly the pixels above the threshold it reports, and the threshold of the percentile mode
+//	  is where the requested fraction of the pixels is reached
+//	- the table of ConnectedComponents matches the labels of its output, and the labels are connected sets
+//	- the values of Statistics and ComponentTable are cleared by the next filter
+// With --bench, every filter is also timed on a large picture, and its throughput (megapixels per second)
+// must not be lower than the one stored in Throughput.txt by more than the tolerance (20% by default).
+// The benchmark depends on the machine, so it is not run by the build.
+// With --record, the signatures and the throughputs measured are written to the files instead of being checked.
+//
+// Usage: ImageProcessingTests [--record] [--bench] [--tolerance t] [directory of Golden.txt and Throughput.txt]
+// Returns 0 if every test passed, 1 otherwise.
+
+#define NOMINMAX
+#include <windows.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <functional>
+#include "../ImageProcessing/Parameters.h"
+
+using namespace std;
+
+// Functions exported by the library
+#define FILTER(name) extern "C" __declspec(dllimport) int __stdcall name(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, KVP* arr, int nArr)
+FILTER(BoxBlur);
+FILTER(GaussianBlur);
+FILTER(Threshold);
+FILTER(SobelEdgeDetector);
+FILTER(LaplacianEdgeDetector);
+FILTER(LaplacianOfGaussian);
+FILTER(HarrisCornerDetector);
+FILTER(ShiTomasiCornerDetector);
+FILTER(CannyEdgeDetector);
+FILTER(ConnectedComponents);
+FILTER(Erode);
+FILTER(Dilate);
+FILTER(Open);
+FILTER(Close);
+FILTER(Gradient);
+extern "C" __declspec(dllimport) int __stdcall Convolve(BYTE* inBGR, BYTE* outBGR, int stride, int width, int height, Kernel* kernel, KVP* arr, int nArr);
+extern "C" __declspec(dllimport) int __stdcall Resize(BYTE* inBGR, int stride, int width, int height, BYTE* outBGR, int outStride, int outWidth, int outHeight, KVP* arr, int nArr);
+extern "C" __declspec(dllimport) int __stdcall ComponentTable(Component* table, int nTable);
+extern "C" __declspec(dllimport) int __stdcall Statistics(KVP* arr, int nArr);
+
+// Bytes added at the end of every row, so that the stride is not a multiple of the row size
+#define PADDING 12
+// Value written to the output buffers before a filter is run, to find the bytes it did not write
+#define SENTINEL 0xCD
+// Number of blocks of the signature in each direction
+#define GRID 4
+
+// Sizes of the test pictures: odd and even, mostly not multiples of 64 (the width of the binary masks words)
+static const int sizes[][2] = { { 7, 5 }, { 8, 6 }, { 97, 131 }, { 96, 130 }, { 317, 211 }, { 128, 64 } };
+// Size of the benchmark picture
+static const int benchWidth = 1921, benchHeight = 1081;
+
+// A picture with its padded rows
+struct Picture {
+	int width, height, stride;
+	vector<BYTE> data;
+
+	Picture(int width, int height) : width(width), height(height), stride(width * 4 + PADDING), data(stride * height, SENTINEL) {}
+};
+
+// Runs a filter from in to out with the given parameters, returns the result of the filter
+typedef function<int(Picture& in, Picture& out, vector<KVP>& arr)> Run;
+
+// One test: a filter, its parameters, and the size of its output relative to the input
+struct Case {
+	string name;
+	Run run;
+	vector<KVP> arr;
+	double scale;
+};
+
+static Run Filter(int(__stdcall *filter)(BYTE*, BYTE*, int, int, int, KVP*, int))
+{
+	return [filter](Picture& in, Picture& out, vector<KVP>& arr) {
+		return filter(in.data.data(), out.data.data(), in.stride, in.width, in.height, arr.data(), (int)arr.size());
+	};
+}
+
+static Run ConvolveWith(const Kernel& kernel)
+{
+	return [kernel](Picture& in, Picture& out, vector<KVP>& arr) {
+		Kernel k = kernel;
+		return Convolve(in.data.data(), out.data.data(), in.stride, in.width, in.height, &k, arr.data(), (int)arr.size());
+	};
+}
+
+static Run ResizeTo()
+{
+	return [](Picture& in, Picture& out, vector<KVP>& arr) {
+		return Resize(in.data.data(), in.stride, in.width, in.height, out.data.data(), out.stride, out.width, out.height, arr.data(), (int)arr.size());
+	};
+}
+
+// Kernels given to Convolve: a dense one, a separable one, a sparse one, and a large one for the FFT
+static vector<double> denseValues, separableValues, sparseValues, largeValues;
+
+static void InitKernels()
+{
+	for (int i = 0; i < 5; i++)
+		for (int j = 0; j < 5; j++)
+			denseValues.push_back(((i * 5 + j) * 7 % 11 - 5) / 25.0);
+	const double g[7] = { 1, 6, 15, 20, 15, 6, 1 };
+	for (int i = 0; i < 7; i++)
+		for (int j = 0; j < 7; j++)
+			separableValues.push_back(g[i] * g[j] / 4096);
+	sparseValues.assign(9 * 9, 0);
+	sparseValues[0] = sparseValues[8] = sparseValues[72] = sparseValues[80] = 0.25;
+	sparseValues[40] = -0.5;
+	for (int i = 0; i < 41; i++)
+		for (int j = 0; j < 41; j++)
+			largeValues.push_back(1.0 / (41 * 41));
+}
+
+static vector<Case> Cases()
+{
+	static const Kernel dense = { 5, 5, denseValues.data() };
+	static const Kernel separable = { 7, 7, separableValues.data() };
+	static const Kernel sparse = { 9, 9, sparseValues.data() };
+	static const Kernel large = { 41, 41, largeValues.data() };
+	return {
+		{ "BoxBlur", Filter(BoxBlur), { { "radius", 2 } }, 1 },
+		{ "GaussianBlur", Filter(GaussianBlur), { { "radius", 3 } }, 1 },
+		{ "GaussianBlur.recursive", Filter(GaussianBlur), { { "method", 1 }, { "sigma", 4 } }, 1 },
+		{ "Threshold", Filter(Threshold), { { "threshold", 0.5 } }, 1 },
+		{ "Threshold.otsu", Filter(Threshold), { { "auto", 1 } }, 1 },
+		{ "Threshold.percentile", Filter(Threshold), { { "auto", 2 } }, 1 },
+		{ "SobelEdgeDetector", Filter(SobelEdgeDetector), {}, 1 },
+		{ "SobelEdgeDetector.otsu", Filter(SobelEdgeDetector), { { "auto", 1 } }, 1 },
+		{ "SobelEdgeDetector.percentile", Filter(SobelEdgeDetector), { { "auto", 2 } }, 1 },
+		{ "LaplacianEdgeDetector", Filter(LaplacianEdgeDetector), {}, 1 },
+		{ "LaplacianEdgeDetector.otsu", Filter(LaplacianEdgeDetector), { { "auto", 1 } }, 1 },
+		{ "LaplacianEdgeDetector.percentile", Filter(LaplacianEdgeDetector), { { "auto", 2 }, { "percentile", 0.8 } }, 1 },
+		{ "LaplacianOfGaussian", Filter(LaplacianOfGaussian), {}, 1 },
+		{ "HarrisCornerDetector", Filter(HarrisCornerDetector), {}, 1 },
+		{ "HarrisCornerDetector.otsu", Filter(HarrisCornerDetector), { { "auto", 1 } }, 1 },
+		{ "HarrisCornerDetector.percentile", Filter(HarrisCornerDetector), { { "auto", 2 }, { "percentile", 0.95 } }, 1 },
+		{ "ShiTomasiCornerDetector", Filter(ShiTomasiCornerDetector), {}, 1 },
+		{ "ShiTomasiCornerDetector.otsu", Filter(ShiTomasiCornerDetector), { { "auto", 1 } }, 1 },
+		{ "ShiTomasiCornerDetector.percentile", Filter(ShiTomasiCornerDetector), { { "auto", 2 }, { "percentile", 0.95 } }, 1 },
+		{ "CannyEdgeDetector", Filter(CannyEdgeDetector), {}, 1 },
+		{ "CannyEdgeDetector.otsu", Filter(CannyEdgeDetector), { { "auto", 1 } }, 1 },
+		{ "CannyEdgeDetector.percentile", Filter(CannyEdgeDetector), { { "auto", 2 } }, 1 },
+		{ "ConnectedComponents", Filter(ConnectedComponents), { { "threshold", 0.5 } }, 1 },
+		{ "ConnectedComponents.otsu", Filter(ConnectedComponents), { { "threshold", 0.5 }, { "auto", 1 } }, 1 },
+		{ "Convolve.direct", ConvolveWith(dense), { { "strategy", 0 } }, 1 },
+		{ "Convolve.separable", ConvolveWith(separable), { { "strategy", 1 } }, 1 },
+		{ "Convolve.sparse", ConvolveWith(sparse), { { "strategy", 2 } }, 1 },
+		{ "Convolve.fourier", ConvolveWith(large), { { "strategy", 3 } }, 1 },
+		{ "Resize.bilinear", ResizeTo(), { { "filter", 0 } }, 1.5 },
+		{ "Resize.bicubic", ResizeTo(), { { "filter", 1 } }, 0.4 },
+		{ "Resize.lanczos", ResizeTo(), { { "filter", 2 } }, 0.7 },
+		{ "Resize.gaussian", ResizeTo(), { { "filter", 3 } }, 1.3 },
+		{ "Erode", Filter(Erode), { { "radius", 2 } }, 1 },
+		{ "Dilate", Filter(Dilate), { { "radius_x", 3 }, { "radius_y", 1 } }, 1 },
+		{ "Open", Filter(Open), { { "radius", 2 } }, 1 },
+		{ "Close", Filter(Close), { { "radius", 2 } }, 1 },
+		{ "Gradient", Filter(Gradient), { { "radius", 1 } }, 1 },
+		{ "Erode.binary", Filter(Erode), { { "radius", 2 }, { "binary", 1 } }, 1 },
+		{ "Dilate.binary", Filter(Dilate), { { "radius_x", 70 }, { "radius_y", 3 }, { "binary", 1 } }, 1 },
+		{ "Open.binary", Filter(Open), { { "radius", 2 }, { "binary", 1 } }, 1 },
+		{ "Close.binary", Filter(Close), { { "radius", 2 }, { "binary", 1 } }, 1 },
+		{ "Gradient.binary", Filter(Gradient), { { "radius", 1 }, { "binary", 1 } }, 1 },
+	};
+}
+
+// Draws a deterministic picture with flat areas, edges, corners, gradients and some noise,
+// so that every filter has something to find. The mask pictures of the binary filters use the same drawing.
+static void Draw(Picture& picture)
+{
+	unsigned int seed = 12345;
+	for (int i = 0; i < picture.height; i++) {
+		BYTE* p = picture.data.data() + i * picture.stride;
+		for (int j = 0; j < picture.width; j++) {
+			seed = seed * 1103515245 + 12345;
+			int noise = (seed >> 16) % 32;
+			bool square = (i / 16 + j / 16) % 3 == 0;
+			int dx = j - picture.width / 2, dy = i - picture.height / 3;
+			bool disc = dx * dx + dy * dy < picture.width * picture.height / 16;
+			int base = square ? 200 : disc ? 120 : (i + j) % 64;
+			p[j * 4 + 0] = (BYTE)min(255, base + noise);
+			p[j * 4 + 1] = (BYTE)min(255, base / 2 + j % 100 + noise);
+			p[j * 4 + 2] = (BYTE)min(255, (square ? 60 : 230) + noise / 2);
+			p[j * 4 + 3] = 255;
+		}
+	}
+}
+
+// Top left corner of block b of the signature, in a direction of the given size
+static int BlockStart(int b, int size)
+{
+	return b * size / GRID;
+}
+
+// Signature of a picture: the mean of every channel of every block of a GRID x GRID grid, the padding excluded.
+// Unlike a checksum, it can be compared within a tolerance.
+static vector<double> Signature(const Picture& picture)
+{
+	vector<double> signature;
+	for (int by = 0; by < GRID; by++)
+		for (int bx = 0; bx < GRID; bx++) {
+			double sum[4] = { 0, 0, 0, 0 };
+			int pixels = 0;
+			for (int i = BlockStart(by, picture.height); i < BlockStart(by + 1, picture.height); i++)
+				for (int j = BlockStart(bx, picture.width); j < BlockStart(bx + 1, picture.width); j++, pixels++)
+					for (int c = 0; c < 4; c++)
+						sum[c] += picture.data[i * picture.stride + j * 4 + c];
+			for (int c = 0; c < 4; c++)
+				signature.push_back(pixels ? sum[c] / pixels : 0);
+		}
+	return signature;
+}
+
+// Compares a signature with the stored one. A block may differ by 1 on every pixel (rounding) and
+// by 255 on two pixels (a value on the other side of a threshold). Returns the first block out of the tolerance, or -1.
+static int CompareSignature(const Picture& picture, const vector<double>& signature, const vector<double>& stored)
+{
+	if (signature.size() != stored.size())
+		return 0;
+	for (int b = 0; b < GRID * GRID; b++) {
+		const int by = b / GRID, bx = b % GRID;
+		const int pixels = (BlockStart(by + 1, picture.height) - BlockStart(by, picture.height))
+			* (BlockStart(bx + 1, picture.width) - BlockStart(bx, picture.width));
+		const double tolerance = pixels ? 1 + 2 * 255.0 / pixels : 0;
+		for (int c = 0; c < 4; c++)
+			if (fabs(signature[b * 4 + c] - stored[b * 4 + c]) > tolerance + 0.01)
+				return b;
+	}
+	return -1;
+}
+
+static string Format(const vector<double>& values, const char* format)
+{
+	string text;
+	char value[32];
+	for (double v : values) {
+		snprintf(value, sizeof(value), format, v);
+		text += (text.empty() ? "" : " ") + string(value);
+	}
+	return text;
+}
+
+// Returns true if the padding of every row still holds the sentinel
+static bool PaddingKept(const Picture& picture)
+{
+	for (int i = 0; i < picture.height; i++) {
+		const BYTE* p = picture.data.data() + i * picture.stride + picture.width * 4;
+		for (int k = 0; k < PADDING; k++)
+			if (p[k] != SENTINEL)
+				return false;
+	}
+	return true;
+}
+
+// Reads a file of "name value value..." lines. The lines starting with # are comments.
+static map<string, vector<double>> ReadTable(const string& path)
+{
+	map<string, vector<double>> table;
+	ifstream file(path);
+	string line;
+	while (getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		istringstream fields(line);
+		string name;
+		double value;
+		if (!(fields >> name))
+			continue;
+		vector<double>& values = table[name];
+		while (fields >> value)
+			values.push_back(value);
+	}
+	return table;
+}
+
+static void WriteTable(const string& path, const string& header, const map<string, vector<double>>& table, const char* format)
+{
+	ofstream file(path);
+	file << header;
+	for (auto& entry : table)
+		file << entry.first << " " << Format(entry.second, format) << "\n";
+}
+
+// Number of failed tests
+static int failures = 0;
+
+// Prints the result of a test and counts it
+static void Result(const string& name, const vector<string>& errors)
+{
+	printf("%-48s %s\n", name.c_str(), errors.empty() ? "ok" : "FAILED");
+	for (auto& error : errors)
+		printf("\t%s\n", error.c_str());
+	failures += errors.empty() ? 0 : 1;
+}
+
+// Reads a value reported by the last filter, returns false if it was not reported
+static bool Reported(const char* name, double& value)
+{
+	KVP kvp = { name, 0 };
+	if (Statistics(&kvp, 1) != 1)
+		return false;
+	value = kvp.value;
+	return true;
+}
+
+static double Luminance(const BYTE* p)
+{
+	return (0.299 * p[2]) + (0.587 * p[1]) + (0.114 * p[0]);
+}
+
+// Runs a test with the given parameters and the "openMP" and "placement" parameters added
+static int RunCase(Case& test, Picture& in, Picture& out, bool openMP, bool placement)
+{
+	vector<KVP> arr = test.arr;
+	arr.push_back(KVP{ "openMP", openMP ? 1.0 : 0.0 });
+	arr.push_back(KVP{ "placement", placement ? 1.0 : 0.0 });
+	return test.run(in, out, arr);
+}
+
+static int OutputSize(int size, double scale)
+{
+	return scale == 1 ? size : max(1, (int)(size * scale) | 1);
+}
+
+// The strategies of Convolve must give the same result within 1, the Fourier one included
+static void CheckConvolve(Picture& in)
+{
+	static const char* names[] = { "direct", "separable", "sparse", "fourier" };
+	const Kernel kernels[] = { { 5, 5, denseValues.data() }, { 7, 7, separableValues.data() },
+		{ 9, 9, sparseValues.data() }, { 41, 41, largeValues.data() } };
+	for (const Kernel& kernel : kernels) {
+		const string name = "Convolve.strategies." + to_string(kernel.width) + "x" + to_string(kernel.height)
+			+ "." + to_string(in.width) + "x" + to_string(in.height);
+		vector<string> errors;
+		Picture direct(in.width, in.height);
+		for (int strategy = 0; strategy < 4; strategy++) {
+			Picture out(in.width, in.height);
+			Kernel k = kernel;
+			KVP arr[] = { { "strategy", (double)strategy } };
+			double reported = -1;
+			if (Convolve(in.data.data(), (strategy ? out : direct).data.data(), in.stride, in.width, in.height, &k, arr, 1) != 0) {
+				errors.push_back(string(names[strategy]) + " failed");
+				continue;
+			}
+			if (!Reported("strategy", reported) || reported != strategy)
+				errors.push_back(string(names[strategy]) + " reported strategy " + to_string((int)reported));
+			if (!strategy)
+				continue;
+			int worst = 0;
+			for (int i = 0; i < in.height; i++)
+				for (int j = 0; j < in.width * 4; j++)
+					worst = max(worst, abs(out.data[i * in.stride + j] - direct.data[i * in.stride + j]));
+			if (worst > 1)
+				errors.push_back(string(names[strategy]) + " differs from direct by " + to_string(worst));
+		}
+		Result(name, errors);
+	}
+}
+
+// Threshold must keep exactly the pixels whose luminance is above the threshold it reports. In percentile mode,
+// the threshold is the bin of the luminance histogram where the requested fraction of the pixels is reached:
+// at most 1 - percentile of the pixels are above that bin, at least 1 - percentile from it.
+static void CheckThreshold(Picture& in)
+{
+	for (int mode = 0; mode < 3; mode++) {
+		const string name = "Threshold.behaviour.auto" + to_string(mode) + "." + to_string(in.width) + "x" + to_string(in.height);
+		const double percentile = 0.7;
+		KVP arr[] = { { "threshold", 0.5 }, { "auto", (double)mode }, { "percentile", percentile } };
+		Picture out(in.width, in.height);
+		vector<string> errors;
+		double level = 0;
+		if (Threshold(in.data.data(), out.data.data(), in.stride, in.width, in.height, arr, 3) != 0)
+			errors.push_back("the filter failed");
+		else if (mode && !Reported("threshold", level))
+			errors.push_back("no threshold reported");
+		else {
+			if (!mode)
+				level = 0.5 * 255;
+			int above = 0, from = 0, wrong = 0;
+			for (int i = 0; i < in.height; i++)
+				for (int j = 0; j < in.width; j++) {
+					const BYTE* p = &in.data[i * in.stride + j * 4];
+					const BYTE* q = &out.data[i * out.stride + j * 4];
+					const double Y = Luminance(p);
+					above += Y >= level + 1 ? 1 : 0;
+					from += Y >= level ? 1 : 0;
+					if (Y > level ? memcmp(p, q, 4) != 0 : (q[0] | q[1] | q[2]) != 0)
+						wrong++;
+				}
+			if (wrong)
+				errors.push_back(to_string(wrong) + " pixels on the wrong side of the threshold " + to_string(level));
+			const double fraction = (1 - percentile) * in.width * in.height;
+			if (mode == 2 && (above > fraction || from < fraction))
+				errors.push_back(to_string(above) + " pixels above the bin of the threshold and " + to_string(from)
+					+ " from it, for " + to_string(fraction));
+		}
+		Result(name, errors);
+	}
+}
+
+// The table of ConnectedComponents must describe the labels of its output: the count reported, the area and
+// the bounding box of every set. Every pixel above the threshold has a label, and two neighbors above it (8-connectivity)
+// have the same one.
+static void CheckComponents(Picture& in)
+{
+	const string name = "ConnectedComponents.table." + to_string(in.width) + "x" + to_string(in.height);
+	KVP arr[] = { { "threshold", 0.5 } };
+	Picture out(in.width, in.height);
+	vector<string> errors;
+	double reported = -1;
+	if (ConnectedComponents(in.data.data(), out.data.data(), in.stride, in.width, in.height, arr, 1) != 0)
+		errors.push_back("the filter failed");
+	else if (!Reported("components", reported))
+		errors.push_back("no count reported");
+	else {
+		const int count = ComponentTable(NULL, 0);
+		vector<Component> table(count);
+		ComponentTable(table.data(), count);
+		if (count != (int)reported)
+			errors.push_back("the table has " + to_string(count) + " sets, " + to_string((int)reported) + " reported");
+
+		vector<Component> expected(count);
+		for (int c = 0; c < count; c++)
+			expected[c] = Component{ c + 1, 0, in.width, in.height, -1, -1 };
+		int wrong = 0;
+		auto label = [&](int i, int j) { return *reinterpret_cast<int*>(&out.data[i * out.stride + j * 4]); };
+		for (int i = 0; i < in.height; i++)
+			for (int j = 0; j < in.width; j++) {
+				const int l = label(i, j);
+				const bool above = Luminance(&in.data[i * in.stride + j * 4]) > 0.5 * 255;
+				if (above != (l != 0) || l < 0 || l > count) {
+					wrong++;
+					continue;
+				}
+				if (!l)
+					continue;
+				// The neighbors already seen: left, and the three above (8-connectivity)
+				const int di[4] = { 0, -1, -1, -1 }, dj[4] = { -1, -1, 0, 1 };
+				for (int k = 0; k < 4; k++) {
+					const int ni = i + di[k], nj = j + dj[k];
+					if (ni >= 0 && nj >= 0 && nj < in.width && label(ni, nj) && label(ni, nj) != l)
+						wrong++;
+				}
+				Component& c = expected[l - 1];
+				c.area++;
+				c.left = min(c.left, j);
+				c.right = max(c.right, j);
+				c.top = min(c.top, i);
+				c.bottom = max(c.bottom, i);
+			}
+		if (wrong)
+			errors.push_back(to_string(wrong) + " pixels with a wrong label");
+		for (int c = 0; c < count; c++)
+			if (memcmp(&table[c], &expected[c], sizeof(Component)) != 0) {
+				errors.push_back("set " + to_string(c + 1) + " of the table does not match the labels");
+				break;
+			}
+	}
+
+	// The next filter forgets the results
+	Picture blurred(in.width, in.height);
+	BoxBlur(in.data.data(), blurred.data.data(), in.stride, in.width, in.height, NULL, 0);
+	if (Reported("components", reported) || ComponentTable(NULL, 0) != 0)
+		errors.push_back("the results are still given back after another filter");
+	Result(name, errors);
+}
+
+int main(int argc, char* argv[])
+{
+	bool record = false, bench = false;
+	double tolerance = 0.2;
+	string directory = ".";
+	for (int a = 1; a < argc; a++) {
+		if (!strcmp(argv[a], "--record"))
+			record = true;
+		else if (!strcmp(argv[a], "--bench"))
+			bench = true;
+		else if (!strcmp(argv[a], "--tolerance") && a + 1 < argc)
+			tolerance = atof(argv[++a]);
+		else
+			directory = argv[a];
+	}
+	const string goldenPath = directory + "/Golden.txt";
+	const string throughputPath = directory + "/Throughput.txt";
+
+	InitKernels();
+	vector<Case> cases = Cases();
+	map<string, vector<double>> golden = ReadTable(goldenPath), throughput = ReadTable(throughputPath);
+
+	// Correctness: same output on one thread and on every thread, padding kept, stored signature
+	for (auto& size : sizes) {
+		Picture in(size[0], size[1]);
+		Draw(in);
+		for (Case& test : cases) {
+			const string name = test.name + "." + to_string(in.width) + "x" + to_string(in.height);
+			const int outWidth = OutputSize(in.width, test.scale), outHeight = OutputSize(in.height, test.scale);
+			Picture single(outWidth, outHeight), multi(outWidth, outHeight), placed(outWidth, outHeight);
+			vector<string> errors;
+			if (RunCase(test, in, single, false, false) != 0 || RunCase(test, in, multi, true, false) != 0
+				|| RunCase(test, in, placed, true, true) != 0)
+				errors.push_back("the filter failed");
+			else {
+				if (single.data != multi.data)
+					errors.push_back("the outputs on one thread and on every thread differ");
+				if (single.data != placed.data)
+					errors.push_back("the outputs with and without placement differ");
+				if (!PaddingKept(single) || !PaddingKept(multi))
+					errors.push_back("the padding of the rows was written");
+
+				vector<double> signature = Signature(single);
+				int block = -1;
+				if (record)
+					golden[name] = signature;
+				else if (golden.find(name) == golden.end())
+					errors.push_back("no stored signature");
+				else if ((block = CompareSignature(single, signature, golden[name])) >= 0)
+					errors.push_back("block " + to_string(block) + " is " + Format(vector<double>(&signature[block * 4], &signature[block * 4 + 4]), "%.2f")
+						+ " instead of " + Format(vector<double>(&golden[name][block * 4], &golden[name][block * 4 + 4]), "%.2f"));
+			}
+			Result(name, errors);
+		}
+
+		// Behaviour
+		CheckConvolve(in);
+		CheckThreshold(in);
+		CheckComponents(in);
+	}
+
+	// Throughput on every thread, the best time of a few runs
+	if (bench) {
+		Picture in(benchWidth, benchHeight);
+		Draw(in);
+		for (Case& test : cases) {
+			Picture out(OutputSize(in.width, test.scale), OutputSize(in.height, test.scale));
+			double best = 1e30;
+			for (int run = 0; run < 5; run++) {
+				auto start = chrono::steady_clock::now();
+				RunCase(test, in, out, true, false);
+				best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+			}
+			const double mpixels = in.width * in.height / best / 1e6;
+			bool failed = false;
+			string expected;
+			if (record)
+				throughput[test.name] = { mpixels };
+			else if (throughput[test.name].empty())
+				failed = true, expected = "no stored throughput";
+			else if (mpixels < throughput[test.name][0] * (1 - tolerance))
+				failed = true, expected = "stored " + Format(throughput[test.name], "%.1f");
+			printf("%-48s %8.1f Mpixel/s %s %s\n", test.name.c_str(), mpixels, failed ? "FAILED" : "ok", expected.c_str());
+			failures += failed ? 1 : 0;
+		}
+	}
+
+	if (record) {
+		WriteTable(goldenPath, "# Signatures (mean of every channel on a " + to_string(GRID) + "x" + to_string(GRID)
+			+ " grid of blocks) of every test, written by ImageProcessingTests --record\n", golden, "%.2f");
+		if (bench)
+			WriteTable(throughputPath, "# Throughput (Mpixel/s) of every filter on " + to_string(benchWidth) + "x" + to_string(benchHeight)
+				+ ", written by ImageProcessingTests --record --bench\n", throughput, "%.1f");
+		printf("Recorded\n");
+		return failures ? 1 : 0;
+	}
+	printf(failures ? "%d test(s) FAILED\n" : "All tests passed\n", failures);
+	return failures ? 1 : 0;
+}